@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "codec.h"
+#include "archive.h"
+
+_Static_assert(sizeof(archive_header) == 64, "Unexpected archive header size.");
+_Static_assert(sizeof(archive_entry) == 32, "Unexpected archive entry size.");
+_Static_assert(sizeof(archive_chunk) == 8, "Unexpected archive chunk size.");
+
+// Check that a table of 'count' elements of 'size' bytes fits between 'offset' and 'end'.
+static bool TableFits(uint64_t offset, uint64_t count, size_t size, uint64_t end){
+	return offset <= end && count <= (end - offset)/size;
+}
+
+archive* ArchiveOpen(const char* path){
+	int fd = open(path, O_RDONLY);
+	if(fd < 0){
+		fprintf(stderr, "Could not open archive %s.\n", path);
+		return NULL;
+	}
+	
+	struct stat stats;
+	fstat(fd, &stats);
+	if((size_t)stats.st_size < sizeof(archive_header)){
+		fprintf(stderr, "%s is too small to be an archive.\n", path);
+		close(fd);
+		return NULL;
+	}
+	
+	void* data = mmap(NULL, stats.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(data == MAP_FAILED){
+		fprintf(stderr, "Could not map archive %s.\n", path);
+		close(fd);
+		return NULL;
+	}
+	
+	archive* ar = malloc(sizeof(archive));
+	(*ar) = (archive){.data = data, .size = stats.st_size, .fd = fd};
+	memcpy(&ar->header, data, sizeof(archive_header));
+	
+	const archive_header* header = &ar->header;
+	const char* error = NULL;
+	if(memcmp(header->magic, ARCHIVE_MAGIC, sizeof(header->magic)) != 0){
+		error = "bad magic";
+	} else if(header->version != ARCHIVE_VERSION){
+		error = "unsupported version";
+	} else if(!TableFits(header->index_offset, header->block_count, sizeof(archive_entry), ar->size)){
+		error = "truncated index";
+	} else if(header->chunk_size && !TableFits(header->chunk_offset, header->chunk_count, sizeof(archive_chunk), ar->size)){
+		error = "truncated chunk table";
+	} else if(ArchiveChunkCount(header->chunk_size, header->block_size) > ARCHIVE_MAX_CHUNKS){
+		error = "too many chunks per block";
+	} else if(!TableFits(header->dict_offset, header->dict_size, 1, header->index_offset)){
+		error = "dictionary out of bounds";
+	}
+	
+	ar->entries = (const archive_entry*)(ar->data + header->index_offset);
+	ar->chunks = (const archive_chunk*)(ar->data + header->chunk_offset);
+	for(uint64_t i = 0; !error && i < header->block_count; i++){
+		const archive_entry* entry = ar->entries + i;
+		if(entry->offset > header->index_offset || entry->size > header->index_offset - entry->offset){
+			error = "block payload out of bounds";
+		} else if(entry->codec >= CODEC_COUNT){
+			error = "unknown codec";
+		} else if(entry->raw_size > header->block_size){
+			error = "block larger than the block size";
+		} else if(header->chunk_size){
+			unsigned count = ArchiveChunkCount(header->chunk_size, entry->raw_size);
+			if(entry->first_chunk > header->chunk_count || count > header->chunk_count - entry->first_chunk){
+				error = "chunks out of bounds";
+				break;
+			}
+			
+			uint64_t size = 0;
+			for(unsigned j = 0; j < count; j++) size += ar->chunks[entry->first_chunk + j].size;
+			if(size != entry->size) error = "chunk sizes don't match the payload";
+		}
+	}
+	
+	if(error){
+		fprintf(stderr, "Invalid archive %s: %s.\n", path, error);
+		ArchiveClose(ar);
+		return NULL;
+	}
+	
+	return ar;
+}
+
+void ArchiveClose(archive* ar){
+	munmap((void*)ar->data, ar->size);
+	close(ar->fd);
+	free(ar);
+}
+
+bool ArchiveEvict(archive* ar){
+	// The page cache won't drop pages that are still mapped, so drop this process's mappings first.
+	bool success = madvise((void*)ar->data, ar->size, MADV_DONTNEED) == 0;
+	success &= posix_fadvise(ar->fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+	return success;
+}
+
+double ArchiveResidency(const archive* ar){
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t count = (ar->size + page_size - 1)/page_size;
+	unsigned char* pages = malloc(count);
+	
+	size_t resident = 0;
+	if(mincore((void*)ar->data, ar->size, pages) == 0){
+		for(size_t i = 0; i < count; i++) resident += (pages[i] & 1);
+	}
+	
+	free(pages);
+	return (double)resident/count;
+}
+
+struct archive_writer {
+	FILE* file;
+	archive_header header;
+	uint64_t offset;
+	
+	archive_entry* entries;
+	size_t capacity;
+	
+	archive_chunk* chunks;
+	size_t chunk_capacity;
+};
+
+archive_writer* ArchiveWriterOpen(const char* path, uint32_t block_size, uint32_t chunk_size){
+	FILE* file = fopen(path, "wb");
+	if(!file){
+		fprintf(stderr, "Could not open %s for writing.\n", path);
+		return NULL;
+	}
+	
+	archive_writer* writer = malloc(sizeof(archive_writer));
+	(*writer) = (archive_writer){.file = file, .offset = sizeof(archive_header)};
+	memcpy(writer->header.magic, ARCHIVE_MAGIC, sizeof(writer->header.magic));
+	writer->header.version = ARCHIVE_VERSION;
+	writer->header.block_size = block_size;
+	writer->header.chunk_size = chunk_size;
+	
+	// Reserve space for the header. It's written last once the index location is known.
+	fwrite(&writer->header, sizeof(archive_header), 1, file);
+	return writer;
+}
+
+static void PushEntry(archive_writer* writer, const archive_entry* entry){
+	if(writer->header.block_count == writer->capacity){
+		writer->capacity = (writer->capacity ? 2*writer->capacity : 1024);
+		writer->entries = realloc(writer->entries, writer->capacity*sizeof(archive_entry));
+	}
+	
+	writer->entries[writer->header.block_count++] = *entry;
+}
+
+bool ArchiveWriterAppend(archive_writer* writer, archive_entry* entry, const void* payload, const archive_chunk* chunks){
+	unsigned count = ArchiveChunkCount(writer->header.chunk_size, entry->raw_size);
+	if(writer->header.chunk_count + count > writer->chunk_capacity){
+		while(writer->header.chunk_count + count > writer->chunk_capacity){
+			writer->chunk_capacity = (writer->chunk_capacity ? 2*writer->chunk_capacity : 1024);
+		}
+		writer->chunks = realloc(writer->chunks, writer->chunk_capacity*sizeof(archive_chunk));
+	}
+	
+	entry->first_chunk = writer->header.chunk_count;
+	if(count) memcpy(writer->chunks + writer->header.chunk_count, chunks, count*sizeof(archive_chunk));
+	writer->header.chunk_count += count;
+	
+	entry->offset = writer->offset;
+	PushEntry(writer, entry);
+	writer->offset += entry->size;
+	return fwrite(payload, 1, entry->size, writer->file) == entry->size;
+}
+
+bool ArchiveWriterSetDictionary(archive_writer* writer, const void* dict, uint32_t size){
+	writer->header.dict_offset = writer->offset;
+	writer->header.dict_size = size;
+	writer->offset += size;
+	return fwrite(dict, 1, size, writer->file) == size;
+}
+
+void ArchiveWriterAppendShared(archive_writer* writer, const archive_entry* entry){
+	assert(entry->offset + entry->size <= writer->offset);
+	PushEntry(writer, entry);
+}
+
+bool ArchiveWriterClose(archive_writer* writer){
+	writer->header.index_offset = writer->offset;
+	size_t count = writer->header.block_count;
+	bool success = fwrite(writer->entries, sizeof(archive_entry), count, writer->file) == count;
+	
+	writer->header.chunk_offset = writer->header.index_offset + count*sizeof(archive_entry);
+	count = writer->header.chunk_count;
+	success &= fwrite(writer->chunks, sizeof(archive_chunk), count, writer->file) == count;
+	
+	success &= fseek(writer->file, 0, SEEK_SET) == 0;
+	success &= fwrite(&writer->header, sizeof(archive_header), 1, writer->file) == 1;
+	success &= fclose(writer->file) == 0;
+	
+	free(writer->entries);
+	free(writer->chunks);
+	free(writer);
+	return success;
+}
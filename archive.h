@@ -0,0 +1,112 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Indexed block archive written by streampack.
+// Layout: header, block payloads, the index of 'block_count' entries at 'index_offset',
+// then the table of 'chunk_count' chunks at 'chunk_offset'. An optional compression dictionary may be stored anywhere before the index.
+// Blocks with identical contents may share a single payload.
+// All fields are little endian.
+
+#define ARCHIVE_MAGIC "STRMPACK"
+#define ARCHIVE_VERSION 3
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	// Decompressed size of every block except possibly the last.
+	uint32_t block_size;
+	uint64_t block_count;
+	uint64_t index_offset;
+	
+	// When non-zero, each block's payload is a series of independently compressed chunks of this decompressed size.
+	uint32_t chunk_size;
+	// Size of the dictionary every block was compressed with, or 0 if there isn't one.
+	uint32_t dict_size;
+	uint64_t chunk_count;
+	uint64_t chunk_offset;
+	uint64_t dict_offset;
+} archive_header;
+
+typedef struct {
+	// Compressed size of the chunk.
+	uint32_t size;
+	// CRC32C of the decompressed chunk.
+	uint32_t checksum;
+} archive_chunk;
+
+typedef struct {
+	// Offset and size of the compressed payload.
+	uint64_t offset;
+	uint32_t size;
+	// Decompressed size of the block.
+	uint32_t raw_size;
+	// CRC32C of the decompressed block.
+	uint32_t checksum;
+	// Index of the block's first chunk in the chunk table, if the archive has one.
+	uint32_t first_chunk;
+	// A codec_id from codec.h.
+	uint8_t codec;
+	uint8_t _reserved[7];
+} archive_entry;
+
+// A memory mapped archive.
+typedef struct {
+	const uint8_t* data;
+	size_t size;
+	// Kept open to give the kernel advice about the file.
+	int fd;
+	archive_header header;
+	const archive_entry* entries;
+	const archive_chunk* chunks;
+} archive;
+
+// Map and validate an archive. Prints a message and returns NULL on failure.
+archive* ArchiveOpen(const char* path);
+void ArchiveClose(archive* ar);
+
+// Drop the archive from the page cache so the next reads come from the disk. Returns false if the kernel refused.
+bool ArchiveEvict(archive* ar);
+// Fraction of the archive's pages in the page cache.
+double ArchiveResidency(const archive* ar);
+
+static inline const void* ArchivePayload(const archive* ar, uint64_t idx){
+	return ar->data + ar->entries[idx].offset;
+}
+
+// The archive's dictionary, or NULL if it doesn't have one.
+static inline const void* ArchiveDictionary(const archive* ar){
+	return ar->header.dict_size ? ar->data + ar->header.dict_offset : NULL;
+}
+
+// Most chunks a block may be split into. Readers decode a block's chunks in parallel and keep per chunk state for each one.
+#define ARCHIVE_MAX_CHUNKS 256
+
+// Number of chunks 'raw_size' bytes is split into, or 0 if blocks aren't chunked.
+static inline unsigned ArchiveChunkCount(uint32_t chunk_size, uint32_t raw_size){
+	return chunk_size ? (raw_size + chunk_size - 1)/chunk_size : 0;
+}
+
+// The block's chunks, or NULL if the archive doesn't split blocks.
+static inline const archive_chunk* ArchiveChunks(const archive* ar, uint64_t idx){
+	return ar->header.chunk_size ? ar->chunks + ar->entries[idx].first_chunk : NULL;
+}
+
+typedef struct archive_writer archive_writer;
+
+// Create an archive. Pass a 'chunk_size' of 0 to store blocks whole. Prints a message and returns NULL on failure.
+archive_writer* ArchiveWriterOpen(const char* path, uint32_t block_size, uint32_t chunk_size);
+// Store the dictionary blocks are compressed with.
+bool ArchiveWriterSetDictionary(archive_writer* writer, const void* dict, uint32_t size);
+// Append a block's payload. 'entry' supplies everything except the offset and first chunk, which are filled in.
+// 'chunks' lists the chunks in the payload when the archive is chunked, and is ignored otherwise.
+bool ArchiveWriterAppend(archive_writer* writer, archive_entry* entry, const void* payload, const archive_chunk* chunks);
+// Append an index entry that shares the payload of an earlier block. 'entry' must be a copy of that block's entry.
+void ArchiveWriterAppendShared(archive_writer* writer, const archive_entry* entry);
+// Write the index, chunk table and header, then free the writer.
+bool ArchiveWriterClose(archive_writer* writer);
+
+#endif // ARCHIVE_H
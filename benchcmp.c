@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <unistd.h>
+
+// Compares benchmark results written by 'streamtest -J' against a baseline, and fails if any got worse than the tolerances allow.
+// Results are matched by name. Ones missing from the baseline, or skipped because the backend is unavailable, are reported but don't fail the comparison.
+// Lines starting with '#' are comments, such as the machine the baseline was recorded on, and are printed as they're read.
+
+#define MAX_RESULTS 256
+
+typedef struct {
+	char name[128];
+	double gbps, core_seconds_per_gb, p99_us;
+	bool skipped;
+} result;
+
+// Read a file in the exact format WriteBenchResult() in streamtest.c writes. Returns the number of results, or -1 on error.
+static int ReadResults(const char* path, result* results){
+	FILE* file = fopen(path, "r");
+	if(!file){
+		fprintf(stderr, "Could not open %s.\n", path);
+		return -1;
+	}
+	
+	int count = 0;
+	char line[512];
+	while(fgets(line, sizeof(line), file)){
+		if(line[0] == '\n') continue;
+		if(line[0] == '#'){
+			printf("%s: %s", path, line);
+			continue;
+		}
+		
+		result* r = results + count;
+		(*r) = (result){0};
+		int end = 0;
+		if(count < MAX_RESULTS && sscanf(line, "{\"name\": \"%127[^\"]\", \"skipped\": true}%n", r->name, &end) == 1 && end > 0){
+			r->skipped = true;
+		} else if(count == MAX_RESULTS || sscanf(line, "{\"name\": \"%127[^\"]\", \"gbps\": %lf, \"core_s_per_gb\": %lf, \"p99_us\": %lf}",
+			r->name, &r->gbps, &r->core_seconds_per_gb, &r->p99_us
+		) != 4){
+			fprintf(stderr, "Could not parse result %d in %s.\n", count + 1, path);
+			fclose(file);
+			return -1;
+		}
+		count++;
+	}
+	
+	fclose(file);
+	return count;
+}
+
+// Relative change from the baseline, positive when the value grew.
+static double Change(double baseline, double value){
+	return baseline ? value/baseline - 1 : 0;
+}
+
+int main(int argc, char* argv[]){
+	// Percent each metric may get worse by.
+	double throughput_tolerance = 15, cpu_tolerance = 15, latency_tolerance = 40;
+	
+	int opt;
+	bool usage = false;
+	while((opt = getopt(argc, argv, "t:c:l:")) != -1){
+		switch(opt){
+			case 't': throughput_tolerance = strtod(optarg, NULL); break;
+			case 'c': cpu_tolerance = strtod(optarg, NULL); break;
+			case 'l': latency_tolerance = strtod(optarg, NULL); break;
+			default: usage = true; break;
+		}
+	}
+	
+	if(usage || argc - optind != 2){
+		fprintf(stderr, "Usage: %s [-t throughput_tolerance] [-c cpu_tolerance] [-l latency_tolerance] baseline.json results.json\n", argv[0]);
+		fprintf(stderr, "Tolerances are percentages, 15, 15 and 40 by default.\n");
+		return EXIT_FAILURE;
+	}
+	
+	static result baseline[MAX_RESULTS], results[MAX_RESULTS];
+	int baseline_count = ReadResults(argv[optind + 0], baseline);
+	int result_count = ReadResults(argv[optind + 1], results);
+	if(baseline_count < 0 || result_count < 0) return EXIT_FAILURE;
+	
+	unsigned regressions = 0;
+	printf("%-24s %10s %8s %10s %8s %10s %8s\n", "benchmark", "GB/s", "change", "core-s/GB", "change", "p99 us", "change");
+	for(int i = 0; i < result_count; i++){
+		const result* r = results + i;
+		const result* base = NULL;
+		for(int j = 0; j < baseline_count; j++) if(strcmp(baseline[j].name, r->name) == 0) base = baseline + j;
+		
+		if(r->skipped){
+			printf("%-24s skipped, unavailable on this machine\n", r->name);
+			continue;
+		}
+		
+		if(!base || base->skipped){
+			printf("%-24s %10.2f %8s %10.3f %8s %10.1f %8s  (no baseline)\n", r->name, r->gbps, "", r->core_seconds_per_gb, "", r->p99_us, "");
+			continue;
+		}
+		
+		double gbps = Change(base->gbps, r->gbps);
+		double cpu = Change(base->core_seconds_per_gb, r->core_seconds_per_gb);
+		double latency = Change(base->p99_us, r->p99_us);
+		
+		// Lower throughput is worse, higher CPU use and latency are worse.
+		char failed[64] = "";
+		if(-100*gbps > throughput_tolerance) strcat(failed, " throughput");
+		if(100*cpu > cpu_tolerance) strcat(failed, " cpu");
+		if(100*latency > latency_tolerance) strcat(failed, " latency");
+		
+		printf("%-24s %10.2f %+7.1f%% %10.3f %+7.1f%% %10.1f %+7.1f%%%s%s\n",
+			r->name, r->gbps, 100*gbps, r->core_seconds_per_gb, 100*cpu, r->p99_us, 100*latency,
+			failed[0] ? "  REGRESSION:" : "", failed
+		);
+		if(failed[0]) regressions++;
+	}
+	
+	for(int j = 0; j < baseline_count; j++){
+		bool found = false;
+		for(int i = 0; i < result_count; i++) found |= (strcmp(baseline[j].name, results[i].name) == 0);
+		if(!found) printf("%-24s missing from the results\n", baseline[j].name);
+	}
+	
+	if(regressions){
+		printf("%u of %d benchmarks regressed.\n", regressions, result_count);
+		return EXIT_FAILURE;
+	}
+	
+	printf("No regressions against %s.\n", argv[optind + 0]);
+	return EXIT_SUCCESS;
+}
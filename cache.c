@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "tinycthread.h"
+#include "cache.h"
+
+typedef struct cache_entry cache_entry;
+struct cache_entry {
+	uint64_t key;
+	size_t size;
+	uint64_t cost;
+	// Next entry in the hash bucket.
+	cache_entry* next;
+	
+	// Protected by the stripe lock.
+	unsigned refcount;
+	bool resident;
+	bool referenced;
+	
+	// Keep the block data aligned to a cache line.
+	_Alignas(64) uint8_t data[];
+};
+
+typedef struct {
+	_Alignas(64) mtx_t lock;
+	
+	cache_entry** buckets;
+	unsigned bucket_mask;
+	
+	// Resident entries in CLOCK order.
+	cache_entry** ring;
+	unsigned ring_count, ring_capacity, hand;
+	
+	size_t bytes, budget;
+	block_cache_stats stats;
+} cache_stripe;
+
+struct block_cache {
+	cache_stripe* stripes;
+	unsigned stripe_mask;
+};
+
+static uint64_t HashKey(uint64_t key){
+	// splitmix64 finalizer.
+	key ^= key >> 30; key *= 0xBF58476D1CE4E5B9;
+	key ^= key >> 27; key *= 0x94D049BB133111EB;
+	return key ^ (key >> 31);
+}
+
+static cache_stripe* GetStripe(block_cache* cache, uint64_t hash){
+	return cache->stripes + ((hash >> 48) & cache->stripe_mask);
+}
+
+static cache_entry** FindEntry(cache_stripe* stripe, uint64_t hash, uint64_t key){
+	cache_entry** cursor = stripe->buckets + (hash & stripe->bucket_mask);
+	while(*cursor && (*cursor)->key != key) cursor = &(*cursor)->next;
+	return cursor;
+}
+
+block_cache* BlockCacheNew(size_t budget, unsigned stripes){
+	assert(stripes > 0 && (stripes & (stripes - 1)) == 0);
+	
+	block_cache* cache = malloc(sizeof(block_cache));
+	cache->stripes = aligned_alloc(_Alignof(cache_stripe), stripes*sizeof(cache_stripe));
+	cache->stripe_mask = stripes - 1;
+	
+	// Size the hash tables for roughly one 16 KB block per bucket.
+	unsigned buckets = 16;
+	while((size_t)buckets*16*1024 < budget/stripes) buckets *= 2;
+	
+	for(unsigned i = 0; i < stripes; i++){
+		cache_stripe* stripe = cache->stripes + i;
+		(*stripe) = (cache_stripe){
+			.buckets = calloc(buckets, sizeof(cache_entry*)), .bucket_mask = buckets - 1,
+			.budget = budget/stripes,
+		};
+		mtx_init(&stripe->lock, mtx_plain);
+	}
+	
+	return cache;
+}
+
+void BlockCacheFree(block_cache* cache){
+	for(unsigned i = 0; i <= cache->stripe_mask; i++){
+		cache_stripe* stripe = cache->stripes + i;
+		// Blocks still pinned by a user are leaked.
+		for(unsigned j = 0; j < stripe->ring_count; j++){
+			if(stripe->ring[j]->refcount == 0) free(stripe->ring[j]);
+		}
+		
+		free(stripe->ring);
+		free(stripe->buckets);
+		mtx_destroy(&stripe->lock);
+	}
+	
+	free(cache->stripes);
+	free(cache);
+}
+
+const void* BlockCacheAcquire(block_cache* cache, uint64_t key, size_t* size){
+	uint64_t hash = HashKey(key);
+	cache_stripe* stripe = GetStripe(cache, hash);
+	
+	mtx_lock(&stripe->lock);
+	cache_entry* entry = *FindEntry(stripe, hash, key);
+	if(entry){
+		entry->refcount++;
+		entry->referenced = true;
+		stripe->stats.hits++;
+		stripe->stats.saved_nanos += entry->cost;
+		*size = entry->size;
+	} else {
+		stripe->stats.misses++;
+	}
+	mtx_unlock(&stripe->lock);
+	
+	return entry ? entry->data : NULL;
+}
+
+void* BlockCacheAlloc(block_cache* cache, uint64_t key, size_t capacity){
+	cache_entry* entry = aligned_alloc(_Alignof(cache_entry), (sizeof(cache_entry) + capacity + 63) & ~(size_t)63);
+	(*entry) = (cache_entry){.key = key, .size = capacity, .refcount = 1};
+	return entry->data;
+}
+
+static cache_entry* EntryFromData(const void* data){
+	return (cache_entry*)((uint8_t*)data - offsetof(cache_entry, data));
+}
+
+// Remove the entry under the hand from the cache.
+static void Evict(cache_stripe* stripe){
+	cache_entry* entry = stripe->ring[stripe->hand];
+	
+	cache_entry** cursor = FindEntry(stripe, HashKey(entry->key), entry->key);
+	assert(*cursor == entry);
+	*cursor = entry->next;
+	
+	// Fill the hole with the last entry in the ring.
+	cache_entry* last = stripe->ring[--stripe->ring_count];
+	stripe->ring[stripe->hand] = last;
+	if(stripe->hand >= stripe->ring_count) stripe->hand = 0;
+	
+	entry->resident = false;
+	stripe->bytes -= entry->size;
+	stripe->stats.evictions++;
+	if(entry->refcount == 0) free(entry);
+}
+
+void BlockCacheInsert(block_cache* cache, void* data, size_t size, uint64_t cost){
+	cache_entry* entry = EntryFromData(data);
+	entry->size = size;
+	entry->cost = cost;
+	
+	uint64_t hash = HashKey(entry->key);
+	cache_stripe* stripe = GetStripe(cache, hash);
+	if(size > stripe->budget) return;
+	
+	mtx_lock(&stripe->lock);
+	cache_entry** cursor = FindEntry(stripe, hash, entry->key);
+	if(*cursor == NULL){
+		// Sweep the CLOCK hand, giving referenced entries a second chance.
+		while(stripe->bytes + size > stripe->budget){
+			cache_entry* candidate = stripe->ring[stripe->hand];
+			if(candidate->referenced){
+				candidate->referenced = false;
+				stripe->hand = (stripe->hand + 1) % stripe->ring_count;
+			} else {
+				Evict(stripe);
+			}
+		}
+		
+		if(stripe->ring_count == stripe->ring_capacity){
+			stripe->ring_capacity = (stripe->ring_capacity ? 2*stripe->ring_capacity : 64);
+			stripe->ring = realloc(stripe->ring, stripe->ring_capacity*sizeof(cache_entry*));
+		}
+		
+		// New entries start unreferenced so a block that's never reused is the first to go.
+		stripe->ring[stripe->ring_count++] = entry;
+		entry->resident = true;
+		stripe->bytes += size;
+		
+		// Re-find the bucket since eviction may have changed the chain.
+		cursor = FindEntry(stripe, hash, entry->key);
+		*cursor = entry;
+	}
+	mtx_unlock(&stripe->lock);
+}
+
+void BlockCacheRelease(block_cache* cache, const void* data){
+	cache_entry* entry = EntryFromData(data);
+	cache_stripe* stripe = GetStripe(cache, HashKey(entry->key));
+	
+	mtx_lock(&stripe->lock);
+	bool unused = (--entry->refcount == 0 && !entry->resident);
+	mtx_unlock(&stripe->lock);
+	
+	if(unused) free(entry);
+}
+
+void BlockCacheClear(block_cache* cache){
+	for(unsigned i = 0; i <= cache->stripe_mask; i++){
+		cache_stripe* stripe = cache->stripes + i;
+		mtx_lock(&stripe->lock);
+		uint64_t evictions = stripe->stats.evictions;
+		stripe->hand = 0;
+		while(stripe->ring_count) Evict(stripe);
+		stripe->stats.evictions = evictions;
+		mtx_unlock(&stripe->lock);
+	}
+}
+
+void BlockCacheGetStats(block_cache* cache, block_cache_stats* stats){
+	(*stats) = (block_cache_stats){0};
+	for(unsigned i = 0; i <= cache->stripe_mask; i++){
+		cache_stripe* stripe = cache->stripes + i;
+		mtx_lock(&stripe->lock);
+		stats->hits += stripe->stats.hits;
+		stats->misses += stripe->stats.misses;
+		stats->evictions += stripe->stats.evictions;
+		stats->saved_nanos += stripe->stats.saved_nanos;
+		stats->bytes += stripe->bytes;
+		mtx_unlock(&stripe->lock);
+	}
+}
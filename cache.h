@@ -0,0 +1,42 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Concurrent cache of decompressed blocks with a byte budget.
+// The cache is split into lock striped shards by key, and each shard evicts with its own CLOCK hand.
+// Buffers are reference counted, so an evicted block stays valid until the last user releases it.
+typedef struct block_cache block_cache;
+
+typedef struct {
+	uint64_t hits, misses, evictions;
+	size_t bytes;
+	// Decompression time avoided by hits, in nanoseconds.
+	uint64_t saved_nanos;
+} block_cache_stats;
+
+static inline uint64_t BlockCacheKey(unsigned archive_id, uint64_t block_idx){
+	return (uint64_t)archive_id << 48 | block_idx;
+}
+
+// 'stripes' must be a power of two.
+block_cache* BlockCacheNew(size_t budget, unsigned stripes);
+void BlockCacheFree(block_cache* cache);
+
+// Find and pin a cached block. Returns NULL on a miss.
+const void* BlockCacheAcquire(block_cache* cache, uint64_t key, size_t* size);
+// Allocate a pinned buffer for decoding a missed block into.
+void* BlockCacheAlloc(block_cache* cache, uint64_t key, size_t capacity);
+// Publish a buffer from BlockCacheAlloc() holding 'size' bytes. It remains pinned until released.
+// 'cost' is the time it took to decode in nanoseconds. If another thread already inserted the same block it's not cached.
+void BlockCacheInsert(block_cache* cache, void* data, size_t size, uint64_t cost);
+// Unpin a buffer returned by BlockCacheAcquire() or BlockCacheAlloc().
+void BlockCacheRelease(block_cache* cache, const void* data);
+
+// Evict every block. Pinned blocks stay valid until they're released. Doesn't count towards the eviction stats.
+void BlockCacheClear(block_cache* cache);
+
+void BlockCacheGetStats(block_cache* cache, block_cache_stats* stats);
+
+#endif // CACHE_H
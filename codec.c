@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "lz4.h"
+#include "lz4hc.h"
+#define LZ4F_STATIC_LINKING_ONLY
+#include "lz4frame.h"
+#include "zstd.h"
+#include "zdict.h"
+
+#include "codec.h"
+
+// LZ4 only looks back 64 KB, so only the end of a larger dictionary is useful to it.
+#define LZ4_DICT_MAX (64*1024)
+
+struct codec_dictionary {
+	void* data;
+	size_t size;
+	LZ4F_CDict* lz4f_cdict;
+	ZSTD_CDict* zstd_cdict;
+	ZSTD_DDict* zstd_ddict;
+};
+
+struct codec_context {
+	const codec_dictionary* dict;
+	LZ4_streamHC_t* lz4hc_stream;
+	LZ4F_cctx* lz4f_cctx;
+	LZ4F_dctx* lz4f_dctx;
+	ZSTD_CCtx* zstd_cctx;
+	ZSTD_DCtx* zstd_dctx;
+};
+
+codec_context* CodecContextNew(void){
+	return calloc(1, sizeof(codec_context));
+}
+
+void CodecContextFree(codec_context* ctx){
+	LZ4_freeStreamHC(ctx->lz4hc_stream);
+	if(ctx->lz4f_cctx) LZ4F_freeCompressionContext(ctx->lz4f_cctx);
+	if(ctx->lz4f_dctx) LZ4F_freeDecompressionContext(ctx->lz4f_dctx);
+	ZSTD_freeCCtx(ctx->zstd_cctx);
+	ZSTD_freeDCtx(ctx->zstd_dctx);
+	free(ctx);
+}
+
+void CodecContextSetDictionary(codec_context* ctx, const codec_dictionary* dict){
+	ctx->dict = dict;
+}
+
+codec_dictionary* CodecDictionaryNew(const void* data, size_t size){
+	codec_dictionary* dict = malloc(sizeof(codec_dictionary));
+	(*dict) = (codec_dictionary){.data = malloc(size), .size = size};
+	memcpy(dict->data, data, size);
+	
+	dict->lz4f_cdict = LZ4F_createCDict(data, size);
+	dict->zstd_cdict = ZSTD_createCDict(data, size, CODECS[CODEC_ZSTD].level);
+	dict->zstd_ddict = ZSTD_createDDict(data, size);
+	return dict;
+}
+
+void CodecDictionaryFree(codec_dictionary* dict){
+	LZ4F_freeCDict(dict->lz4f_cdict);
+	ZSTD_freeCDict(dict->zstd_cdict);
+	ZSTD_freeDDict(dict->zstd_ddict);
+	free(dict->data);
+	free(dict);
+}
+
+size_t CodecTrainDictionary(void* dict, size_t capacity, const void* samples, const size_t* sample_sizes, unsigned sample_count){
+	size_t result = ZDICT_trainFromBuffer(dict, capacity, samples, sample_sizes, sample_count);
+	return ZDICT_isError(result) ? 0 : result;
+}
+
+// The part of the dictionary that LZ4 can reference.
+static const char* LZ4Dict(const codec_dictionary* dict, int* size){
+	size_t lz4_size = (dict->size < LZ4_DICT_MAX ? dict->size : LZ4_DICT_MAX);
+	*size = lz4_size;
+	return (const char*)dict->data + (dict->size - lz4_size);
+}
+
+static size_t StoreBound(size_t size){return size;}
+
+static size_t StoreCompress(codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size, int level){
+	if(src_size > dst_size) return 0;
+	memcpy(dst, src, src_size);
+	return src_size;
+}
+
+static size_t StoreDecompress(codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size){
+	if(src_size > dst_size) return SIZE_MAX;
+	memcpy(dst, src, src_size);
+	return src_size;
+}
+
+static size_t StoreDecompressProgressive(
+	codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size,
+	size_t step, codec_progress_func* progress, void* user_data
+){
+	if(src_size > dst_size) return SIZE_MAX;
+	for(size_t offset = 0; offset < src_size; offset += step){
+		size_t size = (src_size - offset < step ? src_size - offset : step);
+		memcpy((uint8_t*)dst + offset, (const uint8_t*)src + offset, size);
+		progress(user_data, (uint8_t*)dst + offset, size);
+	}
+	return src_size;
+}
+
+static size_t LZ4Bound(size_t size){return LZ4_compressBound(size);}
+
+static size_t LZ4Compress(codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size, int level){
+	int result;
+	if(ctx->dict){
+		if(ctx->lz4hc_stream == NULL) ctx->lz4hc_stream = LZ4_createStreamHC();
+		
+		int dict_size;
+		const char* dict = LZ4Dict(ctx->dict, &dict_size);
+		LZ4_resetStreamHC_fast(ctx->lz4hc_stream, level);
+		LZ4_loadDictHC(ctx->lz4hc_stream, dict, dict_size);
+		result = LZ4_compress_HC_continue(ctx->lz4hc_stream, src, dst, src_size, dst_size);
+	} else {
+		result = LZ4_compress_HC(src, dst, src_size, dst_size, level);
+	}
+	return result > 0 ? (size_t)result : 0;
+}
+
+static size_t LZ4Decompress(codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size){
+	int result;
+	if(ctx->dict){
+		int dict_size;
+		const char* dict = LZ4Dict(ctx->dict, &dict_size);
+		result = LZ4_decompress_safe_usingDict(src, dst, src_size, dst_size, dict, dict_size);
+	} else {
+		result = LZ4_decompress_safe(src, dst, src_size, dst_size);
+	}
+	return result >= 0 ? (size_t)result : SIZE_MAX;
+}
+
+static const LZ4F_preferences_t LZ4F_PREFS = {
+	.frameInfo = {.contentChecksumFlag = LZ4F_contentChecksumEnabled},
+	.favorDecSpeed = 1,
+};
+
+static size_t LZ4FBound(size_t size){return LZ4F_compressFrameBound(size, &LZ4F_PREFS);}
+
+static size_t LZ4FCompress(codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size, int level){
+	if(ctx->lz4f_cctx == NULL) LZ4F_createCompressionContext(&ctx->lz4f_cctx, LZ4F_VERSION);
+	
+	// Match the lz4 tool's --best --favor-decSpeed output.
+	LZ4F_preferences_t prefs = LZ4F_PREFS;
+	prefs.compressionLevel = level;
+	const LZ4F_CDict* cdict = (ctx->dict ? ctx->dict->lz4f_cdict : NULL);
+	size_t result = LZ4F_compressFrame_usingCDict(ctx->lz4f_cctx, dst, dst_size, src, src_size, cdict, &prefs);
+	return LZ4F_isError(result) ? 0 : result;
+}
+
+static size_t LZ4FDecompressStep(codec_context* ctx, void* dst, size_t* dst_size, const void* src, size_t* src_size){
+	if(ctx->dict){
+		return LZ4F_decompress_usingDict(ctx->lz4f_dctx, dst, dst_size, src, src_size, ctx->dict->data, ctx->dict->size, NULL);
+	} else {
+		return LZ4F_decompress(ctx->lz4f_dctx, dst, dst_size, src, src_size, NULL);
+	}
+}
+
+static size_t LZ4FDecompress(codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size){
+	if(ctx->lz4f_dctx == NULL) LZ4F_createDecompressionContext(&ctx->lz4f_dctx, LZ4F_VERSION);
+	
+	size_t result = LZ4FDecompressStep(ctx, dst, &dst_size, src, &src_size);
+	if(result != 0){
+		// Error, or the frame was truncated. Either way the context needs to be reset.
+		LZ4F_resetDecompressionContext(ctx->lz4f_dctx);
+		return SIZE_MAX;
+	}
+	return dst_size;
+}
+
+// Frame blocks decode straight into 'dst' when the step is at least the frame's block size, otherwise LZ4F copies through an internal buffer.
+static size_t LZ4FDecompressProgressive(
+	codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size,
+	size_t step, codec_progress_func* progress, void* user_data
+){
+	if(ctx->lz4f_dctx == NULL) LZ4F_createDecompressionContext(&ctx->lz4f_dctx, LZ4F_VERSION);
+	
+	uint8_t* out = dst;
+	const uint8_t* in = src;
+	size_t total = 0;
+	while(true){
+		size_t out_size = (dst_size - total < step ? dst_size - total : step);
+		size_t in_size = src_size;
+		size_t result = LZ4FDecompressStep(ctx, out + total, &out_size, in, &in_size);
+		if(LZ4F_isError(result) || (in_size == 0 && out_size == 0)){
+			// Error, or the frame was truncated.
+			LZ4F_resetDecompressionContext(ctx->lz4f_dctx);
+			return SIZE_MAX;
+		}
+		
+		in += in_size, src_size -= in_size;
+		if(out_size) progress(user_data, out + total, out_size);
+		total += out_size;
+		if(result == 0) return total;
+	}
+}
+
+static size_t ZstdBound(size_t size){return ZSTD_compressBound(size);}
+
+static size_t ZstdCompress(codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size, int level){
+	if(ctx->zstd_cctx == NULL) ctx->zstd_cctx = ZSTD_createCCtx();
+	size_t result;
+	if(ctx->dict){
+		// The digested dictionary was created at the codec's default level.
+		result = ZSTD_compress_usingCDict(ctx->zstd_cctx, dst, dst_size, src, src_size, ctx->dict->zstd_cdict);
+	} else {
+		result = ZSTD_compressCCtx(ctx->zstd_cctx, dst, dst_size, src, src_size, level);
+	}
+	return ZSTD_isError(result) ? 0 : result;
+}
+
+static size_t ZstdDecompress(codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size){
+	if(ctx->zstd_dctx == NULL) ctx->zstd_dctx = ZSTD_createDCtx();
+	size_t result;
+	if(ctx->dict){
+		result = ZSTD_decompress_usingDDict(ctx->zstd_dctx, dst, dst_size, src, src_size, ctx->dict->zstd_ddict);
+	} else {
+		result = ZSTD_decompressDCtx(ctx->zstd_dctx, dst, dst_size, src, src_size);
+	}
+	return ZSTD_isError(result) ? SIZE_MAX : result;
+}
+
+// Decoding in steps goes through zstd's window buffer, so this costs an extra copy compared to ZstdDecompress().
+static size_t ZstdDecompressProgressive(
+	codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size,
+	size_t step, codec_progress_func* progress, void* user_data
+){
+	if(ctx->zstd_dctx == NULL) ctx->zstd_dctx = ZSTD_createDCtx();
+	ZSTD_DCtx_reset(ctx->zstd_dctx, ZSTD_reset_session_only);
+	ZSTD_DCtx_refDDict(ctx->zstd_dctx, ctx->dict ? ctx->dict->zstd_ddict : NULL);
+	
+	ZSTD_inBuffer in = {.src = src, .size = src_size};
+	size_t total = 0;
+	while(true){
+		ZSTD_outBuffer out = {.dst = (uint8_t*)dst + total, .size = (dst_size - total < step ? dst_size - total : step)};
+		size_t result = ZSTD_decompressStream(ctx->zstd_dctx, &out, &in);
+		if(ZSTD_isError(result) || (out.pos == 0 && in.pos == in.size && result != 0)) return SIZE_MAX;
+		
+		if(out.pos) progress(user_data, out.dst, out.pos);
+		total += out.pos;
+		if(result == 0) return total;
+	}
+}
+
+const codec CODECS[CODEC_COUNT] = {
+	[CODEC_STORE] = {
+		.name = "store", .level = 0, .bound = StoreBound, .compress = StoreCompress,
+		.decompress = StoreDecompress, .decompress_progressive = StoreDecompressProgressive,
+	},
+	// Raw LZ4 blocks can only be decoded in one go.
+	[CODEC_LZ4] = {
+		.name = "lz4", .level = LZ4HC_CLEVEL_MAX, .bound = LZ4Bound, .compress = LZ4Compress,
+		.decompress = LZ4Decompress,
+	},
+	[CODEC_LZ4F] = {
+		.name = "lz4f", .level = LZ4HC_CLEVEL_MAX, .bound = LZ4FBound, .compress = LZ4FCompress,
+		.decompress = LZ4FDecompress, .decompress_progressive = LZ4FDecompressProgressive,
+	},
+	[CODEC_ZSTD] = {
+		.name = "zstd", .level = 12, .bound = ZstdBound, .compress = ZstdCompress,
+		.decompress = ZstdDecompress, .decompress_progressive = ZstdDecompressProgressive,
+	},
+};
+
+size_t CodecDecompressProgressive(
+	codec_context* ctx, codec_id id, void* dst, size_t dst_size, const void* src, size_t src_size,
+	size_t step, codec_progress_func* progress, void* user_data
+){
+	if(CODECS[id].decompress_progressive){
+		return CODECS[id].decompress_progressive(ctx, dst, dst_size, src, src_size, step, progress, user_data);
+	} else {
+		size_t size = CODECS[id].decompress(ctx, dst, dst_size, src, src_size);
+		if(size != SIZE_MAX) progress(user_data, dst, size);
+		return size;
+	}
+}
+
+codec_id CodecFind(const char* name){
+	for(unsigned i = 0; i < CODEC_COUNT; i++){
+		if(strcmp(CODECS[i].name, name) == 0) return i;
+	}
+	return CODEC_COUNT;
+}
@@ -0,0 +1,75 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Codec ids are stored per block, so don't renumber them.
+typedef enum {
+	// Uncompressed.
+	CODEC_STORE = 0,
+	// Raw LZ4 block without a frame header.
+	CODEC_LZ4 = 1,
+	// LZ4 frame, as written by the lz4 command line tool.
+	CODEC_LZ4F = 2,
+	// Zstandard frame.
+	CODEC_ZSTD = 3,
+	CODEC_COUNT,
+} codec_id;
+
+// Per thread compression and decompression state. Contexts are created lazily and reused between blocks.
+typedef struct codec_context codec_context;
+
+// A dictionary shared by every block of an archive. It's read only once created, so threads can share it.
+typedef struct codec_dictionary codec_dictionary;
+
+// Called as each span of output becomes valid. Spans are reported in order.
+typedef void codec_progress_func(void* user_data, const void* data, size_t size);
+
+typedef struct {
+	const char* name;
+	// Default compression level.
+	int level;
+	// Worst case compressed size for 'size' input bytes.
+	size_t (*bound)(size_t size);
+	// Returns the compressed size, or 0 on failure.
+	size_t (*compress)(codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size, int level);
+	// Returns the decompressed size, or SIZE_MAX on failure.
+	size_t (*decompress)(codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size);
+	// Streaming version of decompress() that reports progress about every 'step' bytes. (optional)
+	size_t (*decompress_progressive)(
+		codec_context* ctx, void* dst, size_t dst_size, const void* src, size_t src_size,
+		size_t step, codec_progress_func* progress, void* user_data
+	);
+} codec;
+
+extern const codec CODECS[CODEC_COUNT];
+
+codec_context* CodecContextNew(void);
+void CodecContextFree(codec_context* ctx);
+// Compress and decompress with 'dict' from now on, or stop using one if it's NULL.
+void CodecContextSetDictionary(codec_context* ctx, const codec_dictionary* dict);
+
+codec_dictionary* CodecDictionaryNew(const void* data, size_t size);
+void CodecDictionaryFree(codec_dictionary* dict);
+// Train a dictionary of up to 'capacity' bytes from concatenated samples. Returns its size, or 0 on failure.
+size_t CodecTrainDictionary(void* dict, size_t capacity, const void* samples, const size_t* sample_sizes, unsigned sample_count);
+
+// Look up a codec id by name. Returns CODEC_COUNT if it's unknown.
+codec_id CodecFind(const char* name);
+
+static inline size_t CodecCompress(codec_context* ctx, codec_id id, void* dst, size_t dst_size, const void* src, size_t src_size){
+	return CODECS[id].compress(ctx, dst, dst_size, src, src_size, CODECS[id].level);
+}
+
+static inline size_t CodecDecompress(codec_context* ctx, codec_id id, void* dst, size_t dst_size, const void* src, size_t src_size){
+	return CODECS[id].decompress(ctx, dst, dst_size, src, src_size);
+}
+
+// Decompress and call 'progress' as output becomes valid. Codecs that can't stream report everything at the end.
+size_t CodecDecompressProgressive(
+	codec_context* ctx, codec_id id, void* dst, size_t dst_size, const void* src, size_t src_size,
+	size_t step, codec_progress_func* progress, void* user_data
+);
+
+#endif // CODEC_H
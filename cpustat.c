@@ -0,0 +1,60 @@
+#include <string.h>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+
+#include "cpustat.h"
+
+static const uint64_t EVENTS[3] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+
+bool ThreadCountersOpen(thread_counters* counters){
+	bool success = true;
+	for(int i = 0; i < 3; i++){
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = EVENTS[i];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		
+		// pid 0 and cpu -1 follow the calling thread on any CPU.
+		counters->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		success &= (counters->fds[i] >= 0);
+	}
+	
+	if(!success) ThreadCountersClose(counters);
+	return success;
+}
+
+void ThreadCountersClose(thread_counters* counters){
+	for(int i = 0; i < 3; i++){
+		if(counters->fds[i] >= 0) close(counters->fds[i]);
+		counters->fds[i] = -1;
+	}
+}
+
+void ThreadCountersRead(const thread_counters* counters, cpu_usage* usage){
+	uint64_t* values[3] = {&usage->cycles, &usage->instructions, &usage->cache_misses};
+	for(int i = 0; i < 3; i++){
+		uint64_t value;
+		if(counters->fds[i] >= 0 && read(counters->fds[i], &value, sizeof(value)) == sizeof(value)) *values[i] += value;
+	}
+}
+
+void CpuUsageProcess(cpu_usage* usage){
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	usage->user_seconds = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec/1e6;
+	usage->sys_seconds = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec/1e6;
+}
+
+cpu_usage CpuUsageSince(const cpu_usage* start, const cpu_usage* now){
+	return (cpu_usage){
+		.user_seconds = now->user_seconds - start->user_seconds, .sys_seconds = now->sys_seconds - start->sys_seconds,
+		.cycles = now->cycles - start->cycles, .instructions = now->instructions - start->instructions,
+		.cache_misses = now->cache_misses - start->cache_misses,
+	};
+}
@@ -0,0 +1,30 @@
+#ifndef CPUSTAT_H
+#define CPUSTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// CPU time for the whole process, plus hardware counters summed over the threads that opened them.
+typedef struct {
+	double user_seconds, sys_seconds;
+	uint64_t cycles, instructions, cache_misses;
+} cpu_usage;
+
+// Hardware counters for a single thread, read through perf_event_open().
+// Only user space is counted so that they work with the default perf_event_paranoid setting.
+typedef struct {
+	int fds[3];
+} thread_counters;
+
+// Open counters for the calling thread. Returns false if perf events aren't available, such as in most VMs and containers.
+bool ThreadCountersOpen(thread_counters* counters);
+void ThreadCountersClose(thread_counters* counters);
+// Add the thread's counts so far to 'usage'. Can be called from any thread.
+void ThreadCountersRead(const thread_counters* counters, cpu_usage* usage);
+
+// Set the process's user and system CPU time in 'usage'.
+void CpuUsageProcess(cpu_usage* usage);
+// The difference between two samples.
+cpu_usage CpuUsageSince(const cpu_usage* start, const cpu_usage* now);
+
+#endif // CPUSTAT_H
@@ -0,0 +1,106 @@
+#include <stdbool.h>
+#include <string.h>
+
+#if __x86_64__
+	#include <nmmintrin.h>
+#elif __aarch64__ && __ARM_FEATURE_CRC32
+	#include <arm_acle.h>
+#endif
+
+#include "tinycthread.h"
+#include "crc32c.h"
+
+// Reflected Castagnoli polynomial.
+#define CRC32C_POLY 0x82F63B78
+
+static uint32_t TABLE[8][256];
+
+static uint32_t Crc32cTable(uint32_t crc, const uint8_t* data, size_t size){
+	// Align to 8 bytes, then consume a word at a time.
+	while(size && ((uintptr_t)data & 7)){
+		crc = TABLE[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+		size--;
+	}
+	
+	while(size >= 8){
+		uint64_t word;
+		memcpy(&word, data, 8);
+		word ^= crc;
+		crc = (
+			TABLE[7][(word >> 0) & 0xFF] ^ TABLE[6][(word >> 8) & 0xFF] ^
+			TABLE[5][(word >> 16) & 0xFF] ^ TABLE[4][(word >> 24) & 0xFF] ^
+			TABLE[3][(word >> 32) & 0xFF] ^ TABLE[2][(word >> 40) & 0xFF] ^
+			TABLE[1][(word >> 48) & 0xFF] ^ TABLE[0][(word >> 56) & 0xFF]
+		);
+		data += 8, size -= 8;
+	}
+	
+	while(size--) crc = TABLE[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#if __x86_64__
+__attribute__((target("sse4.2")))
+static uint32_t Crc32cHardware(uint32_t crc, const uint8_t* data, size_t size){
+	while(size && ((uintptr_t)data & 7)){
+		crc = _mm_crc32_u8(crc, *data++);
+		size--;
+	}
+	
+	uint64_t crc64 = crc;
+	while(size >= 8){
+		uint64_t word;
+		memcpy(&word, data, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+		data += 8, size -= 8;
+	}
+	crc = (uint32_t)crc64;
+	
+	while(size--) crc = _mm_crc32_u8(crc, *data++);
+	return crc;
+}
+#elif __aarch64__ && __ARM_FEATURE_CRC32
+static uint32_t Crc32cHardware(uint32_t crc, const uint8_t* data, size_t size){
+	while(size && ((uintptr_t)data & 7)){
+		crc = __crc32cb(crc, *data++);
+		size--;
+	}
+	
+	while(size >= 8){
+		uint64_t word;
+		memcpy(&word, data, 8);
+		crc = __crc32cd(crc, word);
+		data += 8, size -= 8;
+	}
+	
+	while(size--) crc = __crc32cb(crc, *data++);
+	return crc;
+}
+#endif
+
+static uint32_t (*CRC32C_FUNC)(uint32_t crc, const uint8_t* data, size_t size);
+static once_flag CRC32C_ONCE = ONCE_FLAG_INIT;
+
+static void Crc32cInit(void){
+	for(unsigned i = 0; i < 256; i++){
+		uint32_t crc = i;
+		for(unsigned j = 0; j < 8; j++) crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+		TABLE[0][i] = crc;
+	}
+	
+	for(unsigned i = 0; i < 256; i++){
+		for(unsigned j = 1; j < 8; j++) TABLE[j][i] = TABLE[0][TABLE[j - 1][i] & 0xFF] ^ (TABLE[j - 1][i] >> 8);
+	}
+	
+	CRC32C_FUNC = Crc32cTable;
+#if __x86_64__
+	if(__builtin_cpu_supports("sse4.2")) CRC32C_FUNC = Crc32cHardware;
+#elif __aarch64__ && __ARM_FEATURE_CRC32
+	CRC32C_FUNC = Crc32cHardware;
+#endif
+}
+
+uint32_t Crc32c(uint32_t crc, const void* data, size_t size){
+	call_once(&CRC32C_ONCE, Crc32cInit);
+	return ~CRC32C_FUNC(~crc, data, size);
+}
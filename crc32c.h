@@ -0,0 +1,11 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli) of 'size' bytes, continuing from 'crc'. Pass 0 to start a new checksum.
+// Uses the SSE 4.2 or ARMv8 CRC instructions when available, and a slicing-by-8 table otherwise.
+uint32_t Crc32c(uint32_t crc, const void* data, size_t size);
+
+#endif // CRC32C_H
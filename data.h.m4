@@ -1,2 +0,0 @@
-`#'define `BLOCK_SIZE' BLOCK_SIZE
-`#'define DATA_LENGTH esyscmd(du -b data01 | awk '{print $1}')
@@ -0,0 +1,45 @@
+#include <inttypes.h>
+#include <math.h>
+
+#include "histogram.h"
+
+uint64_t HistogramBucketValue(unsigned bucket){
+	if(bucket < 2*HISTOGRAM_SUB_BUCKETS) return bucket;
+	
+	unsigned shift = bucket/HISTOGRAM_SUB_BUCKETS - 1;
+	return (uint64_t)(bucket%HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS) << shift;
+}
+
+// Largest value counted by 'bucket'.
+static uint64_t BucketMax(unsigned bucket){
+	return bucket + 1 < HISTOGRAM_BUCKETS ? HistogramBucketValue(bucket + 1) - 1 : UINT64_MAX;
+}
+
+void HistogramMerge(histogram* dst, const histogram* src){
+	for(unsigned i = 0; i < HISTOGRAM_BUCKETS; i++) dst->counts[i] += src->counts[i];
+	dst->total += src->total;
+	if(src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t HistogramPercentile(const histogram* h, double percentile){
+	if(h->total == 0) return 0;
+	
+	uint64_t rank = ceil(percentile/100*h->total);
+	if(rank == 0) rank = 1;
+	
+	uint64_t count = 0;
+	for(unsigned i = 0; i < HISTOGRAM_BUCKETS; i++){
+		count += h->counts[i];
+		if(count >= rank){
+			uint64_t value = BucketMax(i);
+			return value < h->max ? value : h->max;
+		}
+	}
+	return h->max;
+}
+
+void HistogramWriteCSV(const histogram* h, const char* label, FILE* file){
+	for(unsigned i = 0; i < HISTOGRAM_BUCKETS; i++){
+		if(h->counts[i]) fprintf(file, "%s,%"PRIu64",%"PRIu64",%"PRIu64"\n", label, HistogramBucketValue(i), BucketMax(i), h->counts[i]);
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Log-linear histogram in the style of HdrHistogram.
+// Values below 2*HISTOGRAM_SUB_BUCKETS are counted exactly, larger ones to within about 3%.
+// Recording is a couple of instructions, so keep one per thread and merge them to report.
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((65 - HISTOGRAM_SUB_BITS)*HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+	uint64_t counts[HISTOGRAM_BUCKETS];
+	uint64_t total, max;
+} histogram;
+
+static inline unsigned HistogramBucket(uint64_t value){
+	if(value < 2*HISTOGRAM_SUB_BUCKETS) return value;
+	
+	// Each power of two is split into HISTOGRAM_SUB_BUCKETS linear buckets.
+	unsigned shift = (63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BITS;
+	return shift*HISTOGRAM_SUB_BUCKETS + (unsigned)(value >> shift);
+}
+
+static inline void HistogramRecord(histogram* h, uint64_t value){
+	h->counts[HistogramBucket(value)]++;
+	h->total++;
+	if(value > h->max) h->max = value;
+}
+
+// Smallest value counted by 'bucket'.
+uint64_t HistogramBucketValue(unsigned bucket);
+void HistogramMerge(histogram* dst, const histogram* src);
+// Value at 'percentile' (0 to 100), rounded up to the top of its bucket. Returns 0 if the histogram is empty.
+uint64_t HistogramPercentile(const histogram* h, double percentile);
+// Write a CSV row of "label,lower,upper,count" for each non-empty bucket.
+void HistogramWriteCSV(const histogram* h, const char* label, FILE* file);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+
+#include "tinycthread.h"
+
+#define TINA_IMPLEMENTATION
+#include "tina.h"
+
+#define TINA_JOBS_IMPLEMENTATION
+#include "tina_jobs.h"
+
+// Regression tests for corner cases in tina_jobs.
+// Most tests run the scheduler on the main thread in flush mode, so a job that's never woken up shows up as
+// tina_scheduler_run() returning before the test is done rather than as a hang.
+// Tests that need an idle worker run it on a thread and give up after a timeout instead.
+
+#define JOB_COUNT 64
+#define FIBER_COUNT 8
+#define STACK_SIZE (64*1024)
+
+// Jobs on this queue are never run, so they stay queued until they're cancelled.
+enum {QUEUE_RUN, QUEUE_PARKED, QUEUE_COUNT};
+
+static tina_scheduler* SCHED;
+static unsigned FAILURES;
+
+#define CHECK(_COND_) if(!(_COND_)){ fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #_COND_); FAILURES++; }
+
+static void EmptyJob(tina_job* job, void* user_data, unsigned* thread_id){}
+
+static void CancelJob(tina_job* job, void* user_data, unsigned* thread_id){
+	tina_group_cancel(SCHED, user_data);
+}
+
+// Cancel more jobs than a waiter's threshold leaves in the group while it's waiting.
+static void CancelWaiterJob(tina_job* job, void* user_data, unsigned* thread_id){
+	bool* done = user_data;
+	tina_group group;
+	tina_group_init(&group);
+	
+	tina_job_description parked[8];
+	for(unsigned i = 0; i < 8; i++) parked[i] = (tina_job_description){.name = "EmptyJob", .func = EmptyJob, .queue_idx = QUEUE_PARKED};
+	tina_scheduler_enqueue_batch(SCHED, parked, 8, &group);
+	
+	// Only runs once this job is waiting, since there's one thread.
+	tina_scheduler_enqueue(SCHED, "CancelJob", CancelJob, &group, QUEUE_RUN, NULL);
+	tina_job_wait(job, &group, 2);
+	CHECK(group.cancelled == 8);
+	CHECK(group.completed == 0);
+	
+	// The group must be usable again afterwards.
+	tina_scheduler_enqueue(SCHED, "EmptyJob", EmptyJob, NULL, QUEUE_RUN, &group);
+	tina_job_wait(job, &group, 0);
+	CHECK(group.completed == 1);
+	*done = true;
+}
+
+static void TestCancelUnderThreshold(void){
+	bool done = false;
+	tina_scheduler_enqueue(SCHED, "CancelWaiterJob", CancelWaiterJob, &done, QUEUE_RUN, NULL);
+	tina_scheduler_run(SCHED, QUEUE_RUN, true, 0);
+	CHECK(done);
+}
+
+static void FlagJob(tina_job* job, void* user_data, unsigned* thread_id){
+	atomic_store((atomic_bool*)user_data, true);
+}
+
+// Flush mode must not return while a delayed job is still pending.
+static void TestDelayedFlush(void){
+	atomic_bool done = false;
+	tina_job_description desc = {.name = "FlagJob", .func = FlagJob, .user_data = &done, .queue_idx = QUEUE_RUN};
+	tina_scheduler_enqueue_delayed(SCHED, &desc, NULL, 5*1000*1000);
+	tina_scheduler_run(SCHED, QUEUE_RUN, true, 0);
+	CHECK(atomic_load(&done));
+}
+
+static int WorkerBody(void* data){
+	tina_scheduler_run(SCHED, QUEUE_RUN, false, 0);
+	return 0;
+}
+
+// A worker that went idle before a delayed job was enqueued must still wake up to run it.
+static void TestDelayedIdle(void){
+	thrd_t worker;
+	thrd_create(&worker, WorkerBody, NULL);
+	// Give the worker time to go idle first.
+	thrd_sleep(&(struct timespec){.tv_nsec = 20*1000*1000}, NULL);
+	
+	atomic_bool done = false;
+	tina_job_description desc = {.name = "FlagJob", .func = FlagJob, .user_data = &done, .queue_idx = QUEUE_RUN};
+	tina_scheduler_enqueue_delayed(SCHED, &desc, NULL, 1000*1000);
+	for(unsigned i = 0; i < 1000 && !atomic_load(&done); i++) thrd_sleep(&(struct timespec){.tv_nsec = 1000*1000}, NULL);
+	CHECK(atomic_load(&done));
+	
+	tina_scheduler_pause(SCHED);
+	thrd_join(worker, NULL);
+}
+
+typedef struct {
+	unsigned count, count_at_wake;
+	uint64_t slept_nanos;
+	bool done;
+} sleep_test;
+
+static void CountJob(tina_job* job, void* user_data, unsigned* thread_id){
+	((sleep_test*)user_data)->count++;
+}
+
+static void SleepJob(tina_job* job, void* user_data, unsigned* thread_id){
+	sleep_test* test = user_data;
+	// Queued behind this job, so they only run if sleeping frees the thread.
+	for(unsigned i = 0; i < 4; i++) tina_scheduler_enqueue(SCHED, "CountJob", CountJob, test, QUEUE_RUN, NULL);
+	
+	uint64_t t0 = _TINA_JOBS_NANOS();
+	tina_job_sleep(job, 10*1000*1000);
+	test->slept_nanos = _TINA_JOBS_NANOS() - t0;
+	test->count_at_wake = test->count;
+	test->done = true;
+}
+
+// A sleeping job must let the thread run other jobs, then resume on its queue once the time is up.
+// Flush mode only runs QUEUE_RUN, so the job never finishes if it's resumed anywhere else.
+static void TestSleep(void){
+	sleep_test test = {0};
+	tina_scheduler_enqueue(SCHED, "SleepJob", SleepJob, &test, QUEUE_RUN, NULL);
+	tina_scheduler_run(SCHED, QUEUE_RUN, true, 0);
+	CHECK(test.done);
+	CHECK(test.count_at_wake == 4);
+	CHECK(test.slept_nanos >= 10*1000*1000);
+}
+
+#define CHANNEL_ITEMS 8
+
+typedef struct {
+	tina_channel* chan;
+	unsigned items[CHANNEL_ITEMS];
+	unsigned sent, sent_at_first_receive;
+	unsigned received[CHANNEL_ITEMS], received_count;
+	bool sender_done, receiver_done;
+} channel_test;
+
+static void SendJob(tina_job* job, void* user_data, unsigned* thread_id){
+	channel_test* test = user_data;
+	for(unsigned i = 0; i < CHANNEL_ITEMS; i++){
+		tina_channel_send(job, test->chan, test->items + i);
+		test->sent++;
+	}
+	tina_channel_close(test->chan);
+	test->sender_done = true;
+}
+
+static void ReceiveJob(tina_job* job, void* user_data, unsigned* thread_id){
+	channel_test* test = user_data;
+	test->sent_at_first_receive = test->sent;
+	
+	unsigned* item;
+	while((item = tina_channel_receive(job, test->chan))){
+		CHECK(test->received_count < CHANNEL_ITEMS);
+		if(test->received_count < CHANNEL_ITEMS) test->received[test->received_count++] = *item;
+	}
+	test->receiver_done = true;
+}
+
+// A sender fills the channel and blocks until the receiver drains it. Items must arrive in order,
+// and the receiver must get NULL once the channel is closed and empty.
+static void TestChannelBackpressure(void){
+	channel_test test = {.chan = tina_channel_new(SCHED, 2)};
+	for(unsigned i = 0; i < CHANNEL_ITEMS; i++) test.items[i] = i;
+	
+	// The sender runs first on the one thread, so the receiver only starts once the sender is blocked.
+	tina_scheduler_enqueue(SCHED, "SendJob", SendJob, &test, QUEUE_RUN, NULL);
+	tina_scheduler_enqueue(SCHED, "ReceiveJob", ReceiveJob, &test, QUEUE_RUN, NULL);
+	tina_scheduler_run(SCHED, QUEUE_RUN, true, 0);
+	
+	CHECK(test.sent_at_first_receive == 2);
+	CHECK(test.sender_done && test.receiver_done);
+	CHECK(test.received_count == CHANNEL_ITEMS);
+	for(unsigned i = 0; i < test.received_count; i++) CHECK(test.received[i] == i);
+	tina_channel_free(test.chan);
+}
+
+static void CloseJob(tina_job* job, void* user_data, unsigned* thread_id){
+	tina_channel_close(((channel_test*)user_data)->chan);
+}
+
+// Closing a channel must wake a receiver that's waiting on it while it's empty.
+static void TestChannelClose(void){
+	channel_test test = {.chan = tina_channel_new(SCHED, 2)};
+	tina_scheduler_enqueue(SCHED, "ReceiveJob", ReceiveJob, &test, QUEUE_RUN, NULL);
+	tina_scheduler_enqueue(SCHED, "CloseJob", CloseJob, &test, QUEUE_RUN, NULL);
+	tina_scheduler_run(SCHED, QUEUE_RUN, true, 0);
+	
+	CHECK(test.receiver_done);
+	CHECK(test.received_count == 0);
+	tina_channel_free(test.chan);
+}
+
+int main(void){
+	SCHED = tina_scheduler_new(JOB_COUNT, QUEUE_COUNT, FIBER_COUNT, STACK_SIZE);
+	
+	TestCancelUnderThreshold();
+	TestDelayedFlush();
+	TestDelayedIdle();
+	TestSleep();
+	TestChannelBackpressure();
+	TestChannelClose();
+	
+	tina_scheduler_free(SCHED);
+	if(FAILURES){
+		printf("%u checks failed.\n", FAILURES);
+		return EXIT_FAILURE;
+	}
+	
+	printf("All tina_jobs tests passed.\n");
+	return EXIT_SUCCESS;
+}
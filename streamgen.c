@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "codec.h"
+
+// Generates a synthetic corpus for streampack with a target compression ratio and content mix.
+// Each file stands in for an asset, and is filled with one class of content:
+//   random: incompressible, like textures and audio that are already compressed.
+//   mixed: LZ style matches and skewed literals, like meshes and other structured data.
+//   sparse: long zero runs, like padding and empty mip tails.
+// The match probability of the mixed class is calibrated against the codec so the corpus as a whole
+// compresses by the target ratio when packed in blocks of the given size.
+// An archive has a single block size, so a mix of block sizes is generated as one subset per size.
+// Each subset gets an equal share of the total size in its own subdirectory, calibrated at its own block size,
+// and is meant to be packed into its own archive with 'streampack -b'.
+
+#define CLASS_COUNT 3
+static const char* CLASS_NAMES[CLASS_COUNT] = {"random", "mixed", "sparse"};
+enum {CLASS_RANDOM, CLASS_MIXED, CLASS_SPARSE};
+
+// Blocks of sample data compressed for each calibration step.
+#define CALIBRATION_BLOCKS 8
+#define CALIBRATION_STEPS 16
+// Matches must stay within LZ4's window to be found.
+#define MATCH_WINDOW 65535
+// Mixed content generated before the match window settles.
+#define MIXED_WARMUP (8 << 20)
+#define MAX_BLOCK_SIZES 8
+
+static double RATIO = 2;
+// Fraction of the data in each class.
+static double WEIGHTS[CLASS_COUNT] = {0.3, 0.6, 0.1};
+static size_t MIN_FILE_SIZE = 64 << 10, MAX_FILE_SIZE = 16 << 20;
+static codec_id CODEC = CODEC_LZ4F;
+
+static uint64_t Random(uint64_t* state){
+	// splitmix64
+	uint64_t z = (*state += 0x9E3779B97F4A7C15);
+	z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9;
+	z = (z ^ (z >> 27))*0x94D049BB133111EB;
+	return z ^ (z >> 31);
+}
+
+static double RandomUnit(uint64_t* state){
+	return (Random(state) >> 11)*0x1.0p-53;
+}
+
+static void FillRandom(uint8_t* dst, size_t size, uint64_t* rng){
+	for(size_t i = 0; i < size; i += 8){
+		uint64_t bits = Random(rng);
+		memcpy(dst + i, &bits, size - i < 8 ? size - i : 8);
+	}
+}
+
+// With probability 'match_p' copy a match from up to MATCH_WINDOW bytes back, otherwise emit a literal.
+// Literals come from a skewed alphabet, so entropy coders have something to work with too.
+static void GenerateMixed(uint8_t* dst, size_t start, size_t size, double match_p, uint64_t* rng){
+	size_t i = start;
+	while(i < size){
+		uint64_t bits = Random(rng);
+		if(i >= 4 && RandomUnit(rng) < match_p){
+			size_t window = (i < MATCH_WINDOW ? i : MATCH_WINDOW);
+			size_t offset = 1 + (bits % window);
+			size_t length = 4 + ((bits >> 32) % 60);
+			if(length > size - i) length = size - i;
+			// Byte by byte so overlapping matches repeat.
+			for(size_t j = 0; j < length; j++, i++) dst[i] = dst[i - offset];
+		} else {
+			unsigned symbol = bits & 63;
+			dst[i++] = symbol*symbol/16;
+		}
+	}
+}
+
+// Starting from nothing, the output is much more compressible for its first few MB until the window settles.
+// Every file starts from a window that has already settled, so its ratio doesn't depend on its size.
+static void FillMixed(uint8_t* dst, size_t size, double match_p, uint64_t* rng){
+	static double history_p = -1;
+	static uint8_t* history;
+	if(history_p != match_p){
+		uint64_t history_rng = 0;
+		history = realloc(history, MIXED_WARMUP);
+		GenerateMixed(history, 0, MIXED_WARMUP, match_p, &history_rng);
+		history_p = match_p;
+	}
+	
+	uint8_t* buffer = malloc(MATCH_WINDOW + size);
+	memcpy(buffer, history + MIXED_WARMUP - MATCH_WINDOW, MATCH_WINDOW);
+	GenerateMixed(buffer, MATCH_WINDOW, MATCH_WINDOW + size, match_p, rng);
+	memcpy(dst, buffer + MATCH_WINDOW, size);
+	free(buffer);
+}
+
+// Zero runs broken up by short bursts of noise.
+static void FillSparse(uint8_t* dst, size_t size, uint64_t* rng){
+	size_t i = 0;
+	while(i < size){
+		uint64_t bits = Random(rng);
+		size_t zeros = bits % 1024, noise = (bits >> 32) % 16;
+		for(size_t j = 0; j < zeros && i < size; j++) dst[i++] = 0;
+		for(size_t j = 0; j < noise && i < size; j++) dst[i++] = Random(rng);
+	}
+}
+
+static void Fill(int class, uint8_t* dst, size_t size, double match_p, uint64_t* rng){
+	switch(class){
+		case CLASS_RANDOM: FillRandom(dst, size, rng); break;
+		case CLASS_MIXED: FillMixed(dst, size, match_p, rng); break;
+		case CLASS_SPARSE: FillSparse(dst, size, rng); break;
+	}
+}
+
+// Compressed size as a fraction of the raw size, block by block like streampack does.
+// Blocks that don't compress are stored.
+static double MeasureFraction(codec_context* ctx, codec_id codec, int class, double match_p, size_t block_size){
+	size_t size = CALIBRATION_BLOCKS*block_size;
+	uint8_t* src = malloc(size);
+	uint8_t* dst = malloc(CODECS[codec].bound(block_size));
+	
+	// Same seed every step so the bisection sees a smooth function.
+	uint64_t rng = 1;
+	Fill(class, src, size, match_p, &rng);
+	
+	size_t packed_size = 0;
+	for(size_t offset = 0; offset < size; offset += block_size){
+		size_t block_packed_size = CodecCompress(ctx, codec, dst, CODECS[codec].bound(block_size), src + offset, block_size);
+		packed_size += (block_packed_size && block_packed_size < block_size ? block_packed_size : block_size);
+	}
+	
+	free(src);
+	free(dst);
+	return (double)packed_size/size;
+}
+
+// Parse a size with an optional K, M or G suffix.
+static size_t ParseSize(const char* str){
+	char* end;
+	size_t size = strtoull(str, &end, 0);
+	switch(*end){
+		case 'G': case 'g': size <<= 10; // fallthrough
+		case 'M': case 'm': size <<= 10; // fallthrough
+		case 'K': case 'k': size <<= 10; break;
+	}
+	return size;
+}
+
+// Calibrate for 'block_size' and write 'total_size' bytes of assets to 'dir', which must already exist.
+static bool GenerateCorpus(const char* dir, size_t total_size, size_t block_size, uint64_t* rng){
+	// Solve for the mixed class's compressed fraction that brings the whole mix to the target.
+	codec_context* ctx = CodecContextNew();
+	double fractions[CLASS_COUNT] = {
+		[CLASS_RANDOM] = MeasureFraction(ctx, CODEC, CLASS_RANDOM, 0, block_size),
+		[CLASS_SPARSE] = MeasureFraction(ctx, CODEC, CLASS_SPARSE, 0, block_size),
+	};
+	
+	double match_p = 0;
+	double lo_fraction = MeasureFraction(ctx, CODEC, CLASS_MIXED, 1, block_size);
+	double hi_fraction = MeasureFraction(ctx, CODEC, CLASS_MIXED, 0, block_size);
+	if(WEIGHTS[CLASS_MIXED] > 0){
+		double target = (1/RATIO - WEIGHTS[CLASS_RANDOM]*fractions[CLASS_RANDOM] - WEIGHTS[CLASS_SPARSE]*fractions[CLASS_SPARSE])/WEIGHTS[CLASS_MIXED];
+		if(target <= lo_fraction){
+			match_p = 1;
+		} else if(target < hi_fraction){
+			// More matches compress better, so bisect on the match probability.
+			double lo = 0, hi = 1;
+			for(int i = 0; i < CALIBRATION_STEPS; i++){
+				match_p = (lo + hi)/2;
+				if(MeasureFraction(ctx, CODEC, CLASS_MIXED, match_p, block_size) > target) lo = match_p; else hi = match_p;
+			}
+		}
+	}
+	fractions[CLASS_MIXED] = MeasureFraction(ctx, CODEC, CLASS_MIXED, match_p, block_size);
+	CodecContextFree(ctx);
+	
+	double expected = 0;
+	for(int i = 0; i < CLASS_COUNT; i++) expected += WEIGHTS[i]*fractions[i];
+	if(fabs(1/expected - RATIO) > 0.05*RATIO) fprintf(stderr, "A %.2fx ratio isn't reachable with this mix, the closest is %.2fx.\n", RATIO, 1/expected);
+	
+	printf("Calibrated against %s in %zu KB blocks, mixed content match probability %.3f.\n", CODECS[CODEC].name, block_size >> 10, match_p);
+	for(int i = 0; i < CLASS_COUNT; i++) printf("%8s: %4.0f%% of the data, %.2fx\n", CLASS_NAMES[i], 100*WEIGHTS[i], 1/fractions[i]);
+	
+	// File sizes are log uniform so there are many small assets and a few large ones.
+	// Each file's class is whichever is furthest behind its share of the data.
+	uint8_t* buffer = malloc(MAX_FILE_SIZE);
+	size_t written = 0, class_sizes[CLASS_COUNT] = {0}, file_count = 0;
+	while(written < total_size){
+		double log_size = log(MIN_FILE_SIZE) + RandomUnit(rng)*(log(MAX_FILE_SIZE) - log(MIN_FILE_SIZE));
+		size_t size = exp(log_size);
+		if(size > total_size - written) size = total_size - written;
+		
+		int class = 0;
+		double deficit = -INFINITY;
+		for(int i = 0; i < CLASS_COUNT; i++){
+			double d = WEIGHTS[i]*(written + size) - class_sizes[i];
+			if(WEIGHTS[i] > 0 && d > deficit) class = i, deficit = d;
+		}
+		Fill(class, buffer, size, match_p, rng);
+		
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/asset%06zu.%s", dir, file_count, CLASS_NAMES[class]);
+		FILE* file = fopen(path, "wb");
+		if(!file || fwrite(buffer, 1, size, file) != size || fclose(file) != 0){
+			fprintf(stderr, "Error writing %s.\n", path);
+			free(buffer);
+			return false;
+		}
+		
+		written += size;
+		class_sizes[class] += size;
+		file_count++;
+	}
+	free(buffer);
+	
+	printf("Generated %zu files, %zu MB, expected ratio %.2fx.\n", file_count, written >> 20, 1/expected);
+	return true;
+}
+
+int main(int argc, char* argv[]){
+	const char* output = NULL;
+	size_t total_size = 1 << 30;
+	size_t block_sizes[MAX_BLOCK_SIZES] = {256*1024};
+	unsigned block_size_count = 1;
+	uint64_t seed = 0;
+	
+	int opt;
+	while((opt = getopt(argc, argv, "o:s:r:m:f:b:c:S:")) != -1){
+		switch(opt){
+			case 'o': output = optarg; break;
+			case 's': total_size = ParseSize(optarg); break;
+			case 'r': RATIO = strtod(optarg, NULL); break;
+			case 'm': sscanf(optarg, "%lf,%lf,%lf", WEIGHTS + 0, WEIGHTS + 1, WEIGHTS + 2); break;
+			case 'f': {
+				char* colon = strchr(optarg, ':');
+				MIN_FILE_SIZE = MAX_FILE_SIZE = ParseSize(optarg);
+				if(colon) MAX_FILE_SIZE = ParseSize(colon + 1);
+			} break;
+			case 'b': {
+				// A comma separated list of block sizes.
+				block_size_count = 0;
+				for(char* str = optarg; str && block_size_count < MAX_BLOCK_SIZES; str = strchr(str, ',')){
+					if(*str == ',') str++;
+					block_sizes[block_size_count++] = ParseSize(str);
+				}
+			} break;
+			case 'c': CODEC = CodecFind(optarg); break;
+			case 'S': seed = strtoull(optarg, NULL, 0); break;
+			default: output = NULL; optind = argc; break;
+		}
+	}
+	
+	bool valid_block_sizes = (block_size_count > 0);
+	for(unsigned i = 0; i < block_size_count; i++) valid_block_sizes &= (block_sizes[i] > 0);
+	
+	double weight_sum = WEIGHTS[0] + WEIGHTS[1] + WEIGHTS[2];
+	if(!output || optind != argc || RATIO < 1 || weight_sum <= 0 || MIN_FILE_SIZE == 0 || MIN_FILE_SIZE > MAX_FILE_SIZE || !valid_block_sizes || CODEC == CODEC_COUNT){
+		fprintf(stderr, "Usage: %s [-s total_size] [-r ratio] [-m random,mixed,sparse] [-f min_size:max_size] [-b block_size,...] [-c codec] [-S seed] -o directory\n", argv[0]);
+		fprintf(stderr, "Sizes accept K, M and G suffixes. The mix weights are fractions of the total size.\n");
+		fprintf(stderr, "With several block sizes, each gets an equal share of the data in its own subdirectory, calibrated at that size.\n");
+		fprintf(stderr, "Pack each one with its own block size, at most %d of them.\n", MAX_BLOCK_SIZES);
+		return EXIT_FAILURE;
+	}
+	for(int i = 0; i < CLASS_COUNT; i++) WEIGHTS[i] /= weight_sum;
+	
+	if(mkdir(output, 0755) != 0){
+		fprintf(stderr, "Could not create %s.\n", output);
+		return EXIT_FAILURE;
+	}
+	
+	uint64_t rng = seed;
+	if(block_size_count == 1) return GenerateCorpus(output, total_size, block_sizes[0], &rng) ? EXIT_SUCCESS : EXIT_FAILURE;
+	
+	char dirs[MAX_BLOCK_SIZES][4096];
+	for(unsigned i = 0; i < block_size_count; i++){
+		snprintf(dirs[i], sizeof(dirs[i]), "%s/%zuK", output, block_sizes[i] >> 10);
+		size_t size = total_size/block_size_count + (i < total_size % block_size_count);
+		if(mkdir(dirs[i], 0755) != 0){
+			fprintf(stderr, "Could not create %s.\n", dirs[i]);
+			return EXIT_FAILURE;
+		}
+		if(!GenerateCorpus(dirs[i], size, block_sizes[i], &rng)) return EXIT_FAILURE;
+	}
+	
+	// The manifest for streampack, one archive per subset.
+	printf("Pack each subset at its own block size:\n");
+	for(unsigned i = 0; i < block_size_count; i++){
+		printf("  streampack -b %zu -c %s -o %s.pak %s\n", block_sizes[i], CODECS[CODEC].name, dirs[i], dirs[i]);
+	}
+	return EXIT_SUCCESS;
+}
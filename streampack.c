@@ -0,0 +1,425 @@
+// For nftw().
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+
+#include "tinycthread.h"
+#include "codec.h"
+#include "crc32c.h"
+#include "archive.h"
+
+#define TINA_IMPLEMENTATION
+#include "tina.h"
+
+#define TINA_JOBS_IMPLEMENTATION
+#include "tina_jobs.h"
+
+// Packs files and directories into an indexed block archive for streamtest.
+// Blocks are checksummed and compressed in parallel, then written in order.
+
+#define JOB_COUNT 1024
+// Blocks are handed to the workers this many at a time.
+// The next batch compresses while the previous one is written, so JOB_COUNT must fit two.
+#define PACK_BATCH 256
+
+static uint64_t GetNanos(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000*(uint64_t)ts.tv_sec + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct {
+	archive_entry entry;
+	// The block's uncompressed contents in its input file.
+	const uint8_t* src;
+	void* payload;
+	archive_chunk* chunks;
+	// Index of the first block with the same contents. Equal to the block's own index if it's unique.
+	size_t original;
+} packed_block;
+
+typedef struct {
+	thrd_t thread;
+	codec_context* codec_ctx;
+} worker_context;
+
+static tina_scheduler* SCHED;
+static unsigned WORKER_COUNT;
+static worker_context* WORKERS;
+
+static codec_id CODEC = CODEC_LZ4F;
+static unsigned CHUNK_SIZE;
+
+// Paths of the regular files found in the inputs.
+static char** PATHS;
+static size_t PATH_COUNT, PATH_CAPACITY;
+
+static int AddPath(const char* path, const struct stat* stats, int type, struct FTW* ftw){
+	if(type != FTW_F || !S_ISREG(stats->st_mode)) return 0;
+	
+	if(PATH_COUNT == PATH_CAPACITY){
+		PATH_CAPACITY = (PATH_CAPACITY ? 2*PATH_CAPACITY : 1024);
+		PATHS = realloc(PATHS, PATH_CAPACITY*sizeof(char*));
+	}
+	PATHS[PATH_COUNT++] = strdup(path);
+	return 0;
+}
+
+static int ComparePaths(const void* a, const void* b){
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Open addressed table of unique blocks, keyed by their checksum and size.
+typedef struct {
+	size_t* slots;
+	size_t mask;
+} dedup_table;
+
+static dedup_table DedupNew(size_t block_count){
+	size_t capacity = 16;
+	while(capacity < 2*block_count) capacity *= 2;
+	
+	// Slots hold a block index + 1 so that 0 means empty.
+	return (dedup_table){.slots = calloc(capacity, sizeof(size_t)), .mask = capacity - 1};
+}
+
+// Return the index of an earlier block with the same contents, or add 'idx' to the table and return it.
+static size_t DedupFind(dedup_table* table, const packed_block* blocks, size_t idx){
+	const archive_entry* entry = &blocks[idx].entry;
+	size_t hash = (entry->checksum ^ (uint64_t)entry->raw_size << 32)*0x9E3779B97F4A7C15;
+	
+	for(size_t i = hash >> 32;; i++){
+		size_t* slot = table->slots + (i & table->mask);
+		if(*slot == 0){
+			*slot = idx + 1;
+			return idx;
+		}
+		
+		// Matching checksums are only a hint, so compare the contents too.
+		const archive_entry* other = &blocks[*slot - 1].entry;
+		if(other->checksum == entry->checksum && other->raw_size == entry->raw_size){
+			if(memcmp(blocks[*slot - 1].src, blocks[idx].src, entry->raw_size) == 0) return *slot - 1;
+		}
+	}
+}
+
+// Bytes of samples to train with per byte of dictionary, as zstd recommends.
+#define DICT_SAMPLE_RATIO 100
+// Blocks are split into samples of this size so training sees many examples.
+#define DICT_SAMPLE_SIZE (16*1024)
+
+// Train a dictionary from an even spread of the unique blocks. Returns its size, or 0 if training failed.
+static size_t TrainDictionary(void* dict, size_t capacity, const packed_block* blocks, size_t block_count){
+	size_t unique_size = 0;
+	for(size_t i = 0; i < block_count; i++){
+		if(blocks[i].original == i) unique_size += blocks[i].entry.raw_size;
+	}
+	
+	size_t budget = DICT_SAMPLE_RATIO*capacity;
+	size_t stride = (unique_size + budget - 1)/budget;
+	if(stride == 0) stride = 1;
+	
+	uint8_t* samples = NULL;
+	size_t* sample_sizes = NULL;
+	size_t samples_size = 0, sample_count = 0, sample_capacity = 0;
+	for(size_t i = 0, n = 0; i < block_count; i++){
+		if(blocks[i].original != i || n++ % stride != 0) continue;
+		
+		size_t raw_size = blocks[i].entry.raw_size;
+		samples = realloc(samples, samples_size + raw_size);
+		memcpy(samples + samples_size, blocks[i].src, raw_size);
+		samples_size += raw_size;
+		
+		for(size_t offset = 0; offset < raw_size; offset += DICT_SAMPLE_SIZE){
+			if(sample_count == sample_capacity){
+				sample_capacity = (sample_capacity ? 2*sample_capacity : 1024);
+				sample_sizes = realloc(sample_sizes, sample_capacity*sizeof(size_t));
+			}
+			sample_sizes[sample_count++] = (raw_size - offset < DICT_SAMPLE_SIZE ? raw_size - offset : DICT_SAMPLE_SIZE);
+		}
+	}
+	
+	size_t size = CodecTrainDictionary(dict, capacity, samples, sample_sizes, sample_count);
+	if(size) printf("Trained a %zu KB dictionary from %zu samples.\n", size >> 10, sample_count);
+	
+	free(samples);
+	free(sample_sizes);
+	return size;
+}
+
+// Compress a block. Its raw size and checksum must already be set.
+// With a non-zero 'chunk_size' the chunks are compressed independently so they can be decoded in parallel.
+static void PackBlock(packed_block* block, codec_context* ctx, codec_id codec, uint32_t chunk_size){
+	const uint8_t* src = block->src;
+	size_t size = block->entry.raw_size;
+	size_t step = chunk_size ? chunk_size : size;
+	unsigned count = chunk_size ? ArchiveChunkCount(chunk_size, size) : 1;
+	
+	size_t bound = count*CODECS[codec].bound(step);
+	uint8_t* dst = malloc(bound);
+	archive_chunk* chunks = malloc(count*sizeof(archive_chunk));
+	
+	size_t packed_size = 0;
+	for(unsigned i = 0; i < count && codec != CODEC_STORE; i++){
+		size_t offset = i*step, chunk_raw_size = (size - offset < step ? size - offset : step);
+		size_t chunk_packed_size = CodecCompress(ctx, codec, dst + packed_size, bound - packed_size, src + offset, chunk_raw_size);
+		if(chunk_packed_size == 0) codec = CODEC_STORE;
+		
+		chunks[i] = (archive_chunk){.size = chunk_packed_size, .checksum = Crc32c(0, src + offset, chunk_raw_size)};
+		packed_size += chunk_packed_size;
+	}
+	
+	// Store blocks that don't compress.
+	if(codec == CODEC_STORE || packed_size >= size){
+		codec = CODEC_STORE;
+		memcpy(dst, src, size);
+		packed_size = size;
+		for(unsigned i = 0; i < count; i++){
+			size_t offset = i*step, chunk_raw_size = (size - offset < step ? size - offset : step);
+			chunks[i] = (archive_chunk){.size = chunk_raw_size, .checksum = Crc32c(0, src + offset, chunk_raw_size)};
+		}
+	}
+	
+	block->entry.size = packed_size;
+	block->entry.codec = codec;
+	block->payload = dst;
+	block->chunks = chunks;
+}
+
+
+static void ChecksumJob(tina_job* job, void* user_data, unsigned* thread_id){
+	packed_block* block = user_data;
+	block->entry.checksum = Crc32c(0, block->src, block->entry.raw_size);
+}
+
+static void CompressJob(tina_job* job, void* user_data, unsigned* thread_id){
+	PackBlock(user_data, WORKERS[*thread_id].codec_ctx, CODEC, CHUNK_SIZE);
+}
+
+static int WorkerBody(void* data){
+	tina_scheduler_run(SCHED, 0, false, (unsigned)((worker_context*)data - WORKERS));
+	return 0;
+}
+
+static void StartWorkers(unsigned count){
+	// Every worker may be running a job at once. Compress jobs never suspend,
+	// so the only others holding a fiber are the main thread's blocking waits.
+	SCHED = tina_scheduler_new(JOB_COUNT, 1, count + 4, 64*1024);
+	
+	WORKER_COUNT = count;
+	WORKERS = malloc(WORKER_COUNT*sizeof(worker_context));
+	for(unsigned i = 0; i < WORKER_COUNT; i++){
+		WORKERS[i] = (worker_context){.codec_ctx = CodecContextNew()};
+		thrd_create(&WORKERS[i].thread, WorkerBody, WORKERS + i);
+	}
+}
+
+// Enqueue 'func' for each block in 'list' that 'filter' accepts, or all of them if it's NULL.
+static void EnqueueBlocks(const char* name, tina_job_func* func, packed_block* list, size_t count, const packed_block* filter, tina_group* group){
+	tina_job_description descs[PACK_BATCH];
+	size_t desc_count = 0;
+	for(size_t i = 0; i < count; i++){
+		if(filter && list[i].original != (size_t)(list + i - filter)) continue;
+		descs[desc_count++] = (tina_job_description){.name = name, .func = func, .user_data = list + i};
+	}
+	tina_scheduler_enqueue_batch(SCHED, descs, desc_count, group);
+}
+
+int main(int argc, char* argv[]){
+	const char* output = NULL;
+	unsigned block_size = 256*1024;
+	unsigned repeat = 1;
+	bool dedup = true;
+	size_t dict_capacity = 0;
+	unsigned thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	int opt;
+	while((opt = getopt(argc, argv, "o:b:k:c:n:Dd:j:")) != -1){
+		switch(opt){
+			case 'o': output = optarg; break;
+			case 'b': block_size = strtoul(optarg, NULL, 0); break;
+			case 'k': CHUNK_SIZE = strtoul(optarg, NULL, 0); break;
+			case 'c': CODEC = CodecFind(optarg); break;
+			case 'n': repeat = strtoul(optarg, NULL, 0); break;
+			case 'D': dedup = false; break;
+			case 'd': dict_capacity = strtoul(optarg, NULL, 0); break;
+			case 'j': thread_count = strtoul(optarg, NULL, 0); break;
+			default: output = NULL; optind = argc; break;
+		}
+	}
+	
+	if(!output || optind == argc || block_size == 0 || CODEC == CODEC_COUNT || repeat == 0 || thread_count == 0){
+		fprintf(stderr, "Usage: %s [-b block_size] [-k chunk_size] [-c store|lz4|lz4f|zstd] [-n repeat] [-D] [-d dict_size] [-j threads] -o archive input...\n", argv[0]);
+		fprintf(stderr, "Inputs may be files or directories. Directories are packed recursively in path order.\n");
+		return EXIT_FAILURE;
+	}
+	
+	if(ArchiveChunkCount(CHUNK_SIZE, block_size) > ARCHIVE_MAX_CHUNKS){
+		fprintf(stderr, "A chunk size of %u splits each block into more than %d chunks.\n", CHUNK_SIZE, ARCHIVE_MAX_CHUNKS);
+		return EXIT_FAILURE;
+	}
+	
+	for(int i = optind; i < argc; i++){
+		if(nftw(argv[i], AddPath, 64, 0) != 0){
+			fprintf(stderr, "Could not read %s.\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+	// Directory order depends on the filesystem. Sort so the archive doesn't.
+	qsort(PATHS, PATH_COUNT, sizeof(char*), ComparePaths);
+	
+	// Map the inputs and split each one into blocks. Blocks don't span files, so the last one in each may be short.
+	size_t size = 0, block_count = 0, block_capacity = 1024;
+	packed_block* blocks = malloc(block_capacity*sizeof(packed_block));
+	for(size_t i = 0; i < PATH_COUNT; i++){
+		int fd = open(PATHS[i], O_RDONLY);
+		if(fd < 0){
+			fprintf(stderr, "Could not open %s.\n", PATHS[i]);
+			return EXIT_FAILURE;
+		}
+		
+		struct stat stats;
+		fstat(fd, &stats);
+		size_t file_size = stats.st_size;
+		const uint8_t* data = file_size ? mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0) : NULL;
+		close(fd);
+		if(data == MAP_FAILED){
+			fprintf(stderr, "Could not map %s.\n", PATHS[i]);
+			return EXIT_FAILURE;
+		}
+		
+		for(size_t offset = 0; offset < file_size; offset += block_size){
+			if(block_count == block_capacity){
+				block_capacity *= 2;
+				blocks = realloc(blocks, block_capacity*sizeof(packed_block));
+			}
+			
+			size_t raw_size = (file_size - offset < block_size ? file_size - offset : block_size);
+			blocks[block_count] = (packed_block){.entry = {.raw_size = raw_size}, .src = data + offset, .original = block_count};
+			block_count++;
+		}
+		size += file_size;
+	}
+	
+	StartWorkers(thread_count);
+	printf("Packing %zu files, %zu MB with %u threads.\n", PATH_COUNT, size >> 20, WORKER_COUNT);
+	uint64_t t0 = GetNanos();
+	
+	// Checksum the blocks, keeping at most two batches in flight.
+	tina_group group;
+	tina_group_init(&group);
+	for(size_t start = 0; start < block_count; start += PACK_BATCH){
+		size_t count = (block_count - start < PACK_BATCH ? block_count - start : PACK_BATCH);
+		tina_scheduler_wait_blocking(SCHED, &group, PACK_BATCH);
+		EnqueueBlocks("Checksum", ChecksumJob, blocks + start, count, NULL, &group);
+	}
+	tina_scheduler_wait_blocking(SCHED, &group, 0);
+	
+	// Find the unique blocks.
+	dedup_table table = DedupNew(dedup ? block_count : 0);
+	for(size_t i = 0; dedup && i < block_count; i++) blocks[i].original = DedupFind(&table, blocks, i);
+	free(table.slots);
+	
+	codec_dictionary* dict = NULL;
+	void* dict_data = malloc(dict_capacity);
+	size_t dict_size = 0;
+	if(dict_capacity){
+		dict_size = TrainDictionary(dict_data, dict_capacity, blocks, block_count);
+		if(dict_size){
+			dict = CodecDictionaryNew(dict_data, dict_size);
+			for(unsigned i = 0; i < WORKER_COUNT; i++) CodecContextSetDictionary(WORKERS[i].codec_ctx, dict);
+		} else {
+			fprintf(stderr, "Dictionary training failed, packing without one.\n");
+		}
+	}
+	
+	archive_writer* writer = ArchiveWriterOpen(output, block_size, CHUNK_SIZE);
+	if(!writer) return EXIT_FAILURE;
+	
+	bool success = true;
+	if(dict_size) success &= ArchiveWriterSetDictionary(writer, dict_data, dict_size);
+	
+	// Compress each unique block once. The next batch compresses while the previous one is written.
+	// Repeats write the input again. Without deduplication this reproduces the old cat based test data,
+	// and the payloads are kept to write them again.
+	bool keep_payloads = (repeat > 1 && !dedup);
+	size_t unique_count = 0;
+	// The dictionary counts against the compressed size.
+	size_t packed_size = dict_size;
+	tina_group batch_groups[2];
+	tina_group_init(batch_groups + 0);
+	tina_group_init(batch_groups + 1);
+	
+	size_t batch_count = (block_count + PACK_BATCH - 1)/PACK_BATCH;
+	if(batch_count) EnqueueBlocks("Compress", CompressJob, blocks, block_count < PACK_BATCH ? block_count : PACK_BATCH, blocks, batch_groups + 0);
+	for(size_t batch = 0; batch < batch_count; batch++){
+		size_t next = (batch + 1)*PACK_BATCH;
+		if(next < block_count){
+			size_t count = (block_count - next < PACK_BATCH ? block_count - next : PACK_BATCH);
+			EnqueueBlocks("Compress", CompressJob, blocks + next, count, blocks, batch_groups + (batch + 1)%2);
+		}
+		tina_scheduler_wait_blocking(SCHED, batch_groups + batch%2, 0);
+		
+		size_t end = (next < block_count ? next : block_count);
+		for(size_t i = batch*PACK_BATCH; i < end; i++){
+			packed_block* block = blocks + blocks[i].original;
+			if(block != blocks + i){
+				ArchiveWriterAppendShared(writer, &block->entry);
+				continue;
+			}
+			
+			success &= ArchiveWriterAppend(writer, &block->entry, block->payload, block->chunks);
+			packed_size += block->entry.size;
+			unique_count++;
+			
+			if(!keep_payloads){
+				free(block->payload);
+				free(block->chunks);
+			}
+		}
+	}
+	
+	for(unsigned n = 1; n < repeat; n++){
+		for(size_t i = 0; i < block_count; i++){
+			packed_block* block = blocks + blocks[i].original;
+			if(block != blocks + i || dedup){
+				ArchiveWriterAppendShared(writer, &block->entry);
+			} else {
+				success &= ArchiveWriterAppend(writer, &block->entry, block->payload, block->chunks);
+				packed_size += block->entry.size;
+			}
+		}
+	}
+	
+	if(!ArchiveWriterClose(writer) || !success){
+		fprintf(stderr, "Error writing %s.\n", output);
+		return EXIT_FAILURE;
+	}
+	
+	double seconds = (GetNanos() - t0)/1e9;
+	size_t raw_size = size*repeat;
+	printf("Packed %zu blocks, %zu MB -> %zu MB (%.2fx %s) in %.2f s (%.0f MB/s).\n",
+		block_count*repeat, raw_size >> 20, packed_size >> 20, (double)raw_size/packed_size, CODECS[CODEC].name, seconds, (raw_size >> 20)/seconds
+	);
+	if(dedup) printf("%zu unique blocks, %zu duplicates share their payloads.\n", unique_count, block_count*repeat - unique_count);
+	
+	for(size_t i = 0; keep_payloads && i < block_count; i++){
+		free(blocks[i].payload);
+		free(blocks[i].chunks);
+	}
+	if(dict) CodecDictionaryFree(dict);
+	free(dict_data);
+	free(blocks);
+	return EXIT_SUCCESS;
+}
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <inttypes.h>
@@ -7,13 +9,25 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#if __x86_64__ || __i386__
+	#include <x86intrin.h>
+#endif
 
 #include "tinycthread.h"
-#include "lz4.h"
-#include "lz4frame.h"
+#include "codec.h"
+#include "crc32c.h"
+#include "archive.h"
+#include "cache.h"
+#include "histogram.h"
+#include "cpustat.h"
+#include "uring.h"
 
 #define TINA_IMPLEMENTATION
 // #define _TINA_ASSERT(_COND_, _MESSAGE_) //{ if(!(_COND_)){fprintf(stdout, _MESSAGE_"\n"); abort();} }
@@ -22,133 +36,1559 @@
 #define TINA_JOBS_IMPLEMENTATION
 #include "tina_jobs.h"
 
-#include "data.h"
-
 u_int64_t GetNanos(void){
 	struct timespec ts;
 	clock_gettime(CLOCK_MONOTONIC, &ts);
 	return 1000000000*(u_int64_t)ts.tv_sec + (u_int64_t)ts.tv_nsec;
 }
 
+// Cheap timestamp for per block costs. On x86 this counts TSC reference cycles, which tick at a fixed rate
+// regardless of the core's current clock. Other platforms fall back to the generic timer or nanoseconds.
+static inline uint64_t GetCycles(void){
+#if __x86_64__ || __i386__
+	return __rdtsc();
+#elif __aarch64__
+	uint64_t ticks;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	return GetNanos();
+#endif
+}
+
+#define JOB_COUNT 1024
+// Most blocks in flight when jobs keep their fibers while they're blocked.
+#define MAX_WINDOW 64
+// Chunk decodes and the bookkeeping jobs only need a small stack. Block decodes and compression get the large ones.
+#define LIGHT_STACK_SIZE (16*1024)
+#define HEAVY_STACK_SIZE (64*1024)
+// Chunks of a single block queued at once.
+#define CHUNK_WINDOW 16
+// Jobs move between queues to run blocking reads on the I/O threads without stalling the workers.
+enum {QUEUE_WORK, QUEUE_IO, QUEUE_URING, QUEUE_COUNT};
+// Threads running QUEUE_IO. Blocking reads in flight are limited to this.
+#define IO_THREAD_COUNT 16
+// Must cover every job that could be in flight.
+#define URING_ENTRIES 64
+// Alignment of O_DIRECT reads. Covers the logical block size of nearly every device.
+#define DIRECT_ALIGNMENT 4096
+// Number of blocks recompressed for the codec comparison.
+#define CODEC_SAMPLE_BLOCKS 256
+#define CACHE_STRIPES 16
+// Number of blocks decoded one at a time to measure latency.
+#define LATENCY_SAMPLES 64
+// Raw data recompressed at each size for the block size sweep, and how much of it each size decodes.
+#define SWEEP_SAMPLE_SIZE (64 << 20)
+#define SWEEP_DECODE_SIZE (256 << 20)
+#define SWEEP_MIN_BLOCK (16 << 10)
+#define SWEEP_MAX_BLOCK (4 << 20)
+// In-flight depths the thread sweep accepts.
+#define MAX_SWEEP_DEPTHS 16
+
+// Sample interval for the in-flight window controller.
+#define THROTTLE_SAMPLE_NANOS 5000000
+#define THROTTLE_MAX_SAMPLES 4096
+// Latency above the baseline by this factor means the extra jobs are just queueing.
+#define THROTTLE_CONGESTED 1.25
+
+typedef struct {
+	uint64_t nanos;
+	unsigned window;
+	double blocks_per_sec;
+	// Estimated nanoseconds from enqueue to completion.
+	double latency;
+} throttle_sample;
+
+// AIMD controller for the number of block jobs in flight.
+// Latency is estimated with Little's law from the completion rate and the average in-flight count.
+// While it stays near the lowest latency seen the window grows by one, otherwise it shrinks by a quarter.
 typedef struct {
-	thrd_t thread;
+	unsigned window, max_window;
+	bool adaptive;
+	
+	uint64_t start_nanos, sample_nanos, last_nanos;
+	size_t sample_completed, last_inflight;
+	double inflight_nanos;
+	double base_latency;
+	
+	throttle_sample samples[THROTTLE_MAX_SAMPLES];
+	size_t sample_count;
+} throttle;
+
+typedef struct {
+	uint64_t blocks, bytes;
+	uint64_t decode_cycles, verify_cycles;
+	// Blocks that were decoded rather than found in the cache, and their summed time until the first and last bytes were valid.
+	uint64_t decoded, first_byte_nanos, last_byte_nanos;
+} decode_stats;
+
+// Stages of a block request, each timed from the end of the previous one.
+// 'io' faults in the compressed payload, and 'decode' decompresses and verifies it. Cache hits skip both.
+typedef enum {STAGE_QUEUE, STAGE_IO, STAGE_DECODE, STAGE_TOTAL, STAGE_COUNT} latency_stage;
+static const char* STAGE_NAMES[STAGE_COUNT] = {"queue", "io", "decode", "total"};
+
+typedef struct {
+	// Cache line aligned so the per worker counters don't false share.
+	_Alignas(64) thrd_t thread;
 	tina_scheduler* sched;
 	unsigned queue_idx;
 	unsigned thread_id;
+	
+	codec_context* codec_ctx;
+	decode_stats stats;
+	// Nanoseconds spent in each stage.
+	histogram latency[STAGE_COUNT];
+	thread_counters counters;
 } worker_context;
 
+// A compressed block and what's needed to decode and verify it.
+typedef struct {
+	// Identifies the block's contents in the cache.
+	uint64_t key;
+	const void* data;
+	size_t size;
+	size_t raw_size;
+	uint32_t checksum;
+	codec_id codec;
+	
+	// Independently compressed chunks of 'chunk_size' raw bytes, if the block was split.
+	const archive_chunk* chunks;
+	unsigned chunk_count;
+	uint32_t chunk_size;
+} block_ref;
+
+// A span of a block's payload that decodes independently.
+typedef struct {
+	const void* src;
+	size_t size;
+	void* dst;
+	size_t raw_size;
+	uint32_t checksum;
+	codec_id codec;
+} chunk_task;
+
+// A block read by the benchmark.
+typedef struct {
+	const block_ref* block;
+	uint64_t enqueue_nanos;
+} block_request;
+
+typedef struct {
+	tina_job_description* descs;
+	// The requests the jobs read. Their enqueue times are set as they're added to the scheduler.
+	block_request* requests;
+	unsigned count;
+} job_list;
+
+// How block payloads are read from the archive.
+//   mmap: fault the mapped pages in.
+//   pread: pread() on the I/O threads.
+//   preadv2: preadv2() with RWF_NOWAIT in place, falling back to the I/O threads on page cache misses.
+//   uring: io_uring reads submitted by the workers and reaped by a dedicated thread.
+//   direct: pread() on the I/O threads through an O_DIRECT descriptor, bypassing the page cache.
+typedef enum {IO_MMAP, IO_PREAD, IO_PREADV2, IO_URING, IO_DIRECT, IO_KIND_COUNT} io_kind;
+static const char* IO_NAMES[IO_KIND_COUNT] = {"mmap", "pread", "preadv2", "uring", "direct"};
+
+typedef enum {ACCESS_SCATTER, ACCESS_SEQUENTIAL, ACCESS_STRIDE, ACCESS_UNIFORM, ACCESS_ZIPF, ACCESS_STREAMS, ACCESS_KIND_COUNT} access_kind;
+static const char* ACCESS_NAMES[ACCESS_KIND_COUNT] = {"scatter", "sequential", "stride", "uniform", "zipf", "streams"};
+
+// Order the benchmark reads blocks in.
+typedef struct {
+	access_kind kind;
+	// Blocks advanced per read for ACCESS_STRIDE, or the number of streams for ACCESS_STREAMS.
+	unsigned count;
+	// Zipf exponent. Larger values concentrate the reads on a smaller hot set.
+	double exponent;
+} access_pattern;
+
 static tina_scheduler* SCHED;
-static unsigned WORKER_COUNT;
-static void* DATA;
+// Workers currently running jobs, out of the MAX_WORKER_COUNT that have contexts.
+static unsigned WORKER_COUNT, MAX_WORKER_COUNT;
+static worker_context* WORKERS;
+// Workers and I/O threads inside tina_scheduler_run().
+static atomic_uint RUNNING_THREADS;
+// I/O threads, then the io_uring reaper.
+static thrd_t IO_THREADS[IO_THREAD_COUNT + 1];
+static thread_counters IO_COUNTERS[IO_THREAD_COUNT + 1];
+// Whether every worker and I/O thread has hardware counters.
+static bool HW_COUNTERS;
+static archive* ARCHIVE;
+// Decompressed size of the largest block, from the archive.
+static uint32_t BLOCK_SIZE;
+// Dictionary the archive's blocks were compressed with, or NULL.
+static codec_dictionary* DICTIONARY;
 static unsigned BLOCK_COUNT;
+// Write a Chrome trace of the job execution to this path. (optional)
+static const char* TRACE_PATH;
+// Fixed in-flight window, or 0 to adapt it at runtime.
+static unsigned FIXED_WINDOW;
+static throttle THROTTLE;
+// Pass decompressed blocks to a consumer job through a bounded channel instead of discarding them.
+static bool PIPELINE;
+static tina_channel* CHANNEL;
+// Order blocks are read in.
+static access_pattern ACCESS = {.kind = ACCESS_SCATTER};
+// Cache of decompressed blocks. (optional)
+static block_cache* CACHE;
+// Decode blocks progressively in steps of this many bytes, or all at once if 0.
+static size_t PROGRESS_STEP;
+static io_kind IO = IO_MMAP;
+// NULL or -1 if unavailable.
+static uring* RING;
+static int DIRECT_FD = -1;
 
 static int WorkerBody(void* data){
 	worker_context* ctx = data;
+	ThreadCountersOpen(&ctx->counters);
+	atomic_fetch_add(&RUNNING_THREADS, 1);
 	tina_scheduler_run(ctx->sched, ctx->queue_idx, false, ctx->thread_id);
+	atomic_fetch_sub(&RUNNING_THREADS, 1);
+	// The counters only follow this thread.
+	ThreadCountersClose(&ctx->counters);
+	return 0;
+}
+
+static int IoThreadBody(void* data){
+	unsigned idx = (uintptr_t)data;
+	ThreadCountersOpen(IO_COUNTERS + idx);
+	atomic_fetch_add(&RUNNING_THREADS, 1);
+	tina_scheduler_run(SCHED, idx < IO_THREAD_COUNT ? QUEUE_IO : QUEUE_URING, false, MAX_WORKER_COUNT + idx);
+	atomic_fetch_sub(&RUNNING_THREADS, 1);
+	ThreadCountersClose(IO_COUNTERS + idx);
 	return 0;
 }
 
+// Verifies output as it becomes valid, and records when the first of it was ready.
+typedef struct {
+	uint32_t crc;
+	uint64_t verify_cycles;
+	uint64_t* first_byte;
+} chunk_progress;
+
+static void ChunkProgress(void* user_data, const void* data, size_t size){
+	chunk_progress* progress = user_data;
+	uint64_t c0 = GetCycles();
+	progress->crc = Crc32c(progress->crc, data, size);
+	progress->verify_cycles += GetCycles() - c0;
+	
+	// A consumer could start parsing the verified data from here on.
+	if(progress->first_byte && *progress->first_byte == 0) *progress->first_byte = GetNanos();
+}
+
+// Decode and verify a chunk. If 'first_byte' is not NULL, it receives the time the start of the output was valid.
+static void DecodeChunk(worker_context* worker, const chunk_task* task, uint64_t* first_byte){
+	chunk_progress progress = {.first_byte = first_byte};
+	
+	uint64_t c0 = GetCycles();
+	size_t size;
+	if(PROGRESS_STEP){
+		// Each step is checksummed as soon as it's decoded while it's still in L1/L2.
+		size = CodecDecompressProgressive(
+			worker->codec_ctx, task->codec, task->dst, task->raw_size, task->src, task->size,
+			PROGRESS_STEP, ChunkProgress, &progress
+		);
+	} else {
+		// Verify immediately while the data is still hot in this core's cache.
+		size = CodecDecompress(worker->codec_ctx, task->codec, task->dst, task->raw_size, task->src, task->size);
+		if(size != SIZE_MAX) ChunkProgress(&progress, task->dst, size);
+	}
+	uint64_t cycles = GetCycles() - c0;
+	assert(size == task->raw_size);
+	
+	if(progress.crc != task->checksum){
+		fprintf(stderr, "Block checksum did not match!\n");
+		abort();
+	}
+	
+	worker->stats.decode_cycles += cycles - progress.verify_cycles;
+	worker->stats.verify_cycles += progress.verify_cycles;
+}
+
+static void ChunkJob(tina_job* job, void* user_data, unsigned* thread_id){
+	DecodeChunk(WORKERS + *thread_id, user_data, NULL);
+}
+
+// Fault in the pages of a mapped range by reading a byte from each.
+static void TouchPages(const void* data, size_t size){
+	const volatile uint8_t* bytes = data;
+	for(size_t i = 0; i < size; i += 4096) (void)bytes[i];
+	if(size) (void)bytes[size - 1];
+}
+
+typedef struct {
+	bool done;
+	int result;
+} uring_read;
+
+static void UringComplete(void* user_data, int result){
+	uring_read* read = user_data;
+	read->result = result;
+	read->done = true;
+}
+
+// Read a block's payload into memory with the selected backend. Returns a pointer to the payload,
+// and sets 'io_buffer' to memory that must be freed afterwards, or NULL if there isn't any.
+// The job returns to QUEUE_WORK before this returns, but possibly on another worker.
+static const uint8_t* ReadPayload(tina_job* job, const block_ref* block, void** io_buffer){
+	*io_buffer = NULL;
+	
+	// Blocks that aren't in the archive, such as the block size sweep's, are already in memory.
+	const uint8_t* data = block->data;
+	if(IO == IO_MMAP || data < ARCHIVE->data || data >= ARCHIVE->data + ARCHIVE->size){
+		TouchPages(data, block->size);
+		return data;
+	}
+	
+	uint64_t offset = data - ARCHIVE->data;
+	if(IO == IO_DIRECT){
+		// The buffer, offset and size must all be aligned. The aligned size may run past the end of the file.
+		uint64_t start = offset & ~(uint64_t)(DIRECT_ALIGNMENT - 1);
+		size_t size = (offset + block->size - start + DIRECT_ALIGNMENT - 1) & ~(size_t)(DIRECT_ALIGNMENT - 1);
+		uint8_t* buffer = *io_buffer = aligned_alloc(DIRECT_ALIGNMENT, size);
+		
+		tina_job_switch_queue(job, QUEUE_IO);
+		ssize_t read_size = pread(DIRECT_FD, buffer, size, start);
+		tina_job_switch_queue(job, QUEUE_WORK);
+		
+		if(read_size < 0 || (uint64_t)read_size < offset + block->size - start){
+			fprintf(stderr, "Could not read a block from the archive.\n");
+			abort();
+		}
+		return buffer + (offset - start);
+	}
+	
+	uint8_t* buffer = *io_buffer = malloc(block->size);
+	size_t done = 0;
+	if(IO == IO_PREADV2){
+		// Page cache hits are copied in place, only misses are handed to the I/O threads.
+		struct iovec iov = {.iov_base = buffer, .iov_len = block->size};
+		ssize_t read_size = preadv2(ARCHIVE->fd, &iov, 1, offset, RWF_NOWAIT);
+		if(read_size > 0) done = read_size;
+	} else if(IO == IO_URING){
+		uring_read read = {0};
+		UringRead(RING, ARCHIVE->fd, buffer, block->size, offset, &read);
+		
+		// The reaper thread runs waiting jobs in order, but reaps every completion while it waits.
+		// By the time a job reaches the front of the queue its read has often finished already.
+		tina_job_switch_queue(job, QUEUE_URING);
+		while(!read.done) UringWait(RING, UringComplete);
+		tina_job_switch_queue(job, QUEUE_WORK);
+		if(read.result > 0) done = read.result;
+	}
+	
+	// Read the rest with plain pread(). This is everything for IO_PREAD, and any short reads from the others.
+	if(done < block->size){
+		tina_job_switch_queue(job, QUEUE_IO);
+		while(done < block->size){
+			ssize_t read_size = pread(ARCHIVE->fd, buffer + done, block->size - done, offset + done);
+			if(read_size <= 0) break;
+			done += read_size;
+		}
+		tina_job_switch_queue(job, QUEUE_WORK);
+	}
+	
+	if(done < block->size){
+		fprintf(stderr, "Could not read a block from the archive.\n");
+		abort();
+	}
+	return buffer;
+}
+
+// Decompress and verify a block the cache didn't have. 'io_done' receives the time the payload was in memory.
+static void* DecodeBlock(tina_job* job, unsigned* thread_id, const block_ref* block, uint64_t* io_done){
+	uint8_t* buffer = CACHE ? BlockCacheAlloc(CACHE, block->key, BLOCK_SIZE) : malloc(BLOCK_SIZE);
+	uint64_t t0 = GetNanos(), first_byte = 0;
+	
+	// Read the payload in up front so reading it is timed separately from decoding it.
+	void* io_buffer;
+	const uint8_t* payload = ReadPayload(job, block, &io_buffer);
+	*io_done = GetNanos();
+	
+	if(block->chunk_count > 1){
+		// Fan the chunks out to other workers, decode the first one here, then wait for the rest.
+		// The arrays are on the heap since a block may have more chunks than fit on a fiber's stack.
+		unsigned count = block->chunk_count;
+		chunk_task* tasks = malloc(count*sizeof(chunk_task));
+		tina_job_description* descs = malloc(count*sizeof(tina_job_description));
+		
+		const uint8_t* src = payload;
+		for(unsigned i = 0; i < count; i++){
+			size_t offset = (size_t)i*block->chunk_size;
+			size_t raw_size = block->raw_size - offset;
+			tasks[i] = (chunk_task){
+				.src = src, .size = block->chunks[i].size, .dst = buffer + offset,
+				.raw_size = raw_size < block->chunk_size ? raw_size : block->chunk_size,
+				.checksum = block->chunks[i].checksum, .codec = block->codec,
+			};
+			descs[i] = (tina_job_description){.name = "ChunkJob", .func = ChunkJob, .user_data = tasks + i};
+			src += block->chunks[i].size;
+		}
+		
+		// Only keep CHUNK_WINDOW chunks queued at once so blocks in flight can't run the scheduler out of jobs.
+		// The group's count is biased by one until it's waited on, so allow one extra job.
+		tina_group group;
+		tina_group_init(&group);
+		unsigned cursor = 1;
+		cursor += tina_scheduler_enqueue_throttled(SCHED, descs + cursor, count - cursor, &group, CHUNK_WINDOW + 1);
+		DecodeChunk(WORKERS + *thread_id, tasks + 0, &first_byte);
+		while(cursor < count){
+			tina_job_wait(job, &group, CHUNK_WINDOW/2);
+			cursor += tina_scheduler_enqueue_throttled(SCHED, descs + cursor, count - cursor, &group, CHUNK_WINDOW + 1);
+		}
+		tina_job_wait(job, &group, 0);
+		free(tasks);
+		free(descs);
+	} else {
+		chunk_task task = {
+			.src = payload, .size = block->size, .dst = buffer,
+			.raw_size = block->raw_size, .checksum = block->checksum, .codec = block->codec,
+		};
+		DecodeChunk(WORKERS + *thread_id, &task, &first_byte);
+	}
+	
+	uint64_t t1 = GetNanos(), nanos = t1 - t0;
+	free(io_buffer);
+	// An empty block never reports progress. Its first byte is ready when the whole block is.
+	if(first_byte == 0) first_byte = t1;
+	
+	// The job may have resumed on a different thread.
+	worker_context* worker = WORKERS + *thread_id;
+	worker->stats.blocks++;
+	worker->stats.bytes += block->raw_size;
+	worker->stats.decoded++;
+	worker->stats.first_byte_nanos += first_byte - t0;
+	worker->stats.last_byte_nanos += nanos;
+	
+	if(CACHE) BlockCacheInsert(CACHE, buffer, block->raw_size, nanos);
+	return buffer;
+}
+
+static void ReleaseBlock(void* buffer){
+	if(CACHE){
+		BlockCacheRelease(CACHE, buffer);
+	} else {
+		free(buffer);
+	}
+}
+
 static void BlockJob(tina_job* job, void* user_data, unsigned* thread_id){
-	// if(memcmp(DATA, user_data, DATA_LENGTH) != 0){
-	// 	fprintf(stderr, "Contents did not match!\n");
-	// 	abort();
-	// } return;
+	const block_request* request = user_data;
+	const block_ref* block = request->block;
+	worker_context* worker = WORKERS + *thread_id;
+	uint64_t start = GetNanos();
+	HistogramRecord(&worker->latency[STAGE_QUEUE], start - request->enqueue_nanos);
 	
-	void* buffer = malloc(BLOCK_SIZE);
+	size_t size;
+	void* buffer = CACHE ? (void*)BlockCacheAcquire(CACHE, block->key, &size) : NULL;
+	if(buffer){
+		worker->stats.blocks++;
+		worker->stats.bytes += size;
+	} else {
+		uint64_t io_done;
+		buffer = DecodeBlock(job, thread_id, block, &io_done);
+		uint64_t decode_done = GetNanos();
+		
+		// The job may have resumed on a different thread.
+		worker = WORKERS + *thread_id;
+		HistogramRecord(&worker->latency[STAGE_IO], io_done - start);
+		HistogramRecord(&worker->latency[STAGE_DECODE], decode_done - io_done);
+	}
+	HistogramRecord(&worker->latency[STAGE_TOTAL], GetNanos() - request->enqueue_nanos);
 	
-	LZ4F_dctx* dctx;
-	LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
-	size_t dst_size = BLOCK_SIZE;
-	size_t src_size = DATA_LENGTH;
-	size_t result = LZ4F_decompress(dctx, buffer, &dst_size, user_data, &src_size, NULL);
-	assert(result == 0);
-	assert(dst_size == BLOCK_SIZE);
-	assert(src_size == DATA_LENGTH);
+	if(CHANNEL){
+		tina_channel_send(job, CHANNEL, buffer);
+	} else {
+		ReleaseBlock(buffer);
+	}
+}
+
+static void ConsumeJob(tina_job* job, void* user_data, unsigned* thread_id){
+	size_t* consumed = user_data;
 	
-	LZ4F_freeDecompressionContext(dctx);
-	free(buffer);
+	void* buffer;
+	while((buffer = tina_channel_receive(job, CHANNEL))){
+		ReleaseBlock(buffer);
+		(*consumed)++;
+	}
+}
+
+static void ThrottleInit(throttle* t, unsigned window, unsigned max_window, bool adaptive){
+	uint64_t now = GetNanos();
+	(*t) = (throttle){
+		.window = window, .max_window = max_window, .adaptive = adaptive,
+		.start_nanos = now, .sample_nanos = now, .last_nanos = now,
+	};
+}
+
+static void ThrottleUpdate(throttle* t, size_t completed, size_t inflight){
+	uint64_t now = GetNanos();
+	t->inflight_nanos += (double)t->last_inflight*(now - t->last_nanos);
+	t->last_nanos = now;
+	t->last_inflight = inflight;
+	
+	uint64_t elapsed = now - t->sample_nanos;
+	size_t count = completed - t->sample_completed;
+	if(elapsed < THROTTLE_SAMPLE_NANOS || count == 0) return;
+	
+	double blocks_per_sec = 1e9*count/elapsed;
+	double latency = (t->inflight_nanos/elapsed)/blocks_per_sec*1e9;
+	if(t->base_latency == 0 || latency < t->base_latency) t->base_latency = latency;
+	
+	if(t->adaptive){
+		if(latency <= THROTTLE_CONGESTED*t->base_latency){
+			if(t->window < t->max_window) t->window++;
+		} else {
+			t->window = t->window*3/4;
+			if(t->window < 1) t->window = 1;
+		}
+	}
+	
+	if(t->sample_count < THROTTLE_MAX_SAMPLES){
+		t->samples[t->sample_count++] = (throttle_sample){
+			.nanos = now - t->start_nanos, .window = t->window, .blocks_per_sec = blocks_per_sec, .latency = latency,
+		};
+	}
+	
+	t->sample_nanos = now;
+	t->sample_completed = completed;
+	t->inflight_nanos = 0;
+}
+
+static void ThrottleReport(const throttle* t){
+	if(t->sample_count == 0) return;
+	
+	double mean_window = 0;
+	for(size_t i = 0; i < t->sample_count; i++) mean_window += t->samples[i].window;
+	printf("in-flight window (%s): mean %.1f, final %u\n", t->adaptive ? "adaptive" : "fixed", mean_window/t->sample_count, t->window);
+	
+	// Print a handful of evenly spaced samples.
+	size_t rows = 16, stride = (t->sample_count + rows - 1)/rows;
+	printf("%10s %8s %12s %12s\n", "time ms", "window", "GB/s decoded", "latency us");
+	for(size_t i = 0; i < t->sample_count; i += stride){
+		const throttle_sample* sample = &t->samples[i];
+		double gbps = sample->blocks_per_sec*BLOCK_SIZE/1024/1024/1024;
+		printf("%10.1f %8u %12.2f %12.1f\n", sample->nanos/1e6, sample->window, gbps, sample->latency/1e3);
+	}
 }
 
 static void RunJobs(tina_job* job, void* user_data, unsigned* thread_id){
-	tina_job_description* descs = user_data;
+	job_list* jobs = user_data;
+	tina_job_description* descs = jobs->descs;
 	
 	tina_group group;
 	tina_group_init(&group);
 	
 	unsigned cursor = 0;
-	while(cursor < BLOCK_COUNT){
-		// for(unsigned i = 0; i < WORKER_COUNT*2; i++){
-		// 	void* ptr = descs[cursor + i].user_data;
-		// 	madvise(ptr, DATA_LENGTH, MADV_SEQUENTIAL);
-		// }
+	while(cursor < jobs->count){
+		// The group's count is biased by one until it's waited on, so allow one extra job.
+		unsigned window = THROTTLE.window;
+		
+		// Stamp every job that could be added now, since they may start before the call returns.
+		uint64_t now = GetNanos();
+		for(unsigned i = cursor; i < jobs->count && i <= cursor + window; i++) jobs->requests[i].enqueue_nanos = now;
 		
-		cursor += tina_scheduler_enqueue_throttled(SCHED, descs + cursor, BLOCK_COUNT - cursor, &group, WORKER_COUNT*2);
-		tina_job_wait(job, &group, WORKER_COUNT);
+		cursor += tina_scheduler_enqueue_throttled(SCHED, descs + cursor, jobs->count - cursor, &group, window + 1);
+		ThrottleUpdate(&THROTTLE, group.completed, cursor - group.completed);
+		// Refill once half of the window has drained.
+		tina_job_wait(job, &group, window/2);
 	}
 	tina_job_wait(job, &group, 0);
+	
+	// Let the consumer finish once the last block has been sent.
+	if(CHANNEL) tina_channel_close(CHANNEL);
 }
 
-static uint64_t RunSequentialSingle(){
-	u_int64_t t0 = GetNanos();
-	// madvise(DATA, BLOCK_COUNT*DATA_LENGTH, MADV_SEQUENTIAL);
-	for(unsigned i = 0; i < BLOCK_COUNT; i++){
-		if(memcmp(DATA, DATA + i*DATA_LENGTH, DATA_LENGTH) != 0){
-			fprintf(stderr, "Contents did not match!\n");
-			abort();
-		}
+// Run the first 'count' workers. Must be called while the scheduler is idle.
+static void SetWorkerCount(unsigned count){
+	assert(0 < count && count <= MAX_WORKER_COUNT);
+	
+	// Pausing stops every thread, so they all restart. A thread still on its way into
+	// tina_scheduler_run() clears the pause flag when it gets there, so keep pausing until they've all left.
+	while(atomic_load(&RUNNING_THREADS) > 0){
+		tina_scheduler_pause(SCHED);
+		thrd_yield();
 	}
-	return GetNanos() - t0;
+	if(WORKER_COUNT){
+		for(unsigned i = 0; i < WORKER_COUNT; i++) thrd_join(WORKERS[i].thread, NULL);
+		for(unsigned i = 0; i <= IO_THREAD_COUNT; i++) thrd_join(IO_THREADS[i], NULL);
+	}
+	
+	WORKER_COUNT = count;
+	for(unsigned i = 0; i < count; i++) thrd_create(&WORKERS[i].thread, WorkerBody, WORKERS + i);
+	for(unsigned i = 0; i <= IO_THREAD_COUNT; i++) thrd_create(IO_THREADS + i, IoThreadBody, (void*)(uintptr_t)i);
+	
+	// Wait for the threads to open their counters so that none are missed.
+	while(atomic_load(&RUNNING_THREADS) < count + IO_THREAD_COUNT + 1) thrd_yield();
+	HW_COUNTERS = true;
+	for(unsigned i = 0; i < count; i++) HW_COUNTERS &= (WORKERS[i].counters.fds[0] >= 0);
+	for(unsigned i = 0; i <= IO_THREAD_COUNT; i++) HW_COUNTERS &= (IO_COUNTERS[i].fds[0] >= 0);
 }
 
-static uint64_t RunRandomParallel(){
-	// Start job system.
-	SCHED = tina_scheduler_new(1024, 1, 32, 64*1024);
+// Start 'count' workers, or one per CPU if it's 0.
+static void StartWorkers(unsigned count){
+	MAX_WORKER_COUNT = (count ? count : sysconf(_SC_NPROCESSORS_ONLN));
 	
-	WORKER_COUNT = sysconf(_SC_NPROCESSORS_ONLN);
-	worker_context WORKERS[WORKER_COUNT];
+	// Every thread may be running a job at once. Light jobs other than RunJobs, ConsumeJob and
+	// the blocking waits never suspend, and heavy ones only hold a fiber while blocked if they're in the window.
+	unsigned thread_count = MAX_WORKER_COUNT + IO_THREAD_COUNT + 1;
+	tina_fiber_pool pools[] = {
+		{.fiber_count = thread_count + 4, .stack_size = LIGHT_STACK_SIZE},
+		{.fiber_count = thread_count + MAX_WINDOW + 1, .stack_size = HEAVY_STACK_SIZE},
+	};
+	SCHED = tina_scheduler_new_pools(JOB_COUNT, QUEUE_COUNT, pools, 2);
 	
-	printf("Starting %d worker threads.\n", WORKER_COUNT);
-	for(unsigned i = 0; i < WORKER_COUNT; i++){
+	WORKERS = aligned_alloc(_Alignof(worker_context), MAX_WORKER_COUNT*sizeof(worker_context));
+	for(unsigned i = 0; i < MAX_WORKER_COUNT; i++){
 		worker_context* worker = WORKERS + i;
-		(*worker) = (worker_context){.sched = SCHED, .queue_idx = 0, .thread_id = i};
-		thrd_create(&worker->thread, WorkerBody, worker);
+		(*worker) = (worker_context){.sched = SCHED, .queue_idx = QUEUE_WORK, .thread_id = i, .codec_ctx = CodecContextNew()};
+		CodecContextSetDictionary(worker->codec_ctx, DICTIONARY);
 	}
 	
+	printf("Starting %d worker threads.\n", MAX_WORKER_COUNT);
+	SetWorkerCount(MAX_WORKER_COUNT);
+	if(!HW_COUNTERS) printf("Hardware counters are unavailable, only CPU time will be reported.\n");
+}
+
+// Process CPU time, and the hardware counters of every thread that runs jobs.
+static cpu_usage GetCpuUsage(void){
+	cpu_usage usage = {0};
+	CpuUsageProcess(&usage);
+	for(unsigned i = 0; i < WORKER_COUNT; i++) ThreadCountersRead(&WORKERS[i].counters, &usage);
+	for(unsigned i = 0; i <= IO_THREAD_COUNT; i++) ThreadCountersRead(IO_COUNTERS + i, &usage);
+	return usage;
+}
+
+static double CoreSecondsPerGB(const cpu_usage* usage, uint64_t bytes){
+	return (usage->user_seconds + usage->sys_seconds)/(bytes/1024.0/1024/1024);
+}
+
+// Print the CPU cost of reading 'bytes' of decompressed data in 'nanos'.
+static void CpuReport(const cpu_usage* usage, uint64_t bytes, uint64_t nanos){
+	double core_seconds = usage->user_seconds + usage->sys_seconds;
+	printf("cpu: %.2f s user, %.2f s sys, %.2f cores busy, %.3f core-seconds per GB\n",
+		usage->user_seconds, usage->sys_seconds, core_seconds/(nanos/1e9), CoreSecondsPerGB(usage, bytes)
+	);
+	if(HW_COUNTERS){
+		printf("cpu: %.3f cycles/byte, %.3f instructions/byte, %.2f IPC, %.3f cache misses per KB (user space)\n",
+			(double)usage->cycles/bytes, (double)usage->instructions/bytes,
+			(double)usage->instructions/usage->cycles, 1024.0*usage->cache_misses/bytes
+		);
+	}
+}
+
+static decode_stats SumStats(void){
+	decode_stats sum = {0};
+	for(unsigned i = 0; i < WORKER_COUNT; i++){
+		const decode_stats* stats = &WORKERS[i].stats;
+		sum.blocks += stats->blocks;
+		sum.bytes += stats->bytes;
+		sum.decode_cycles += stats->decode_cycles;
+		sum.verify_cycles += stats->verify_cycles;
+		sum.decoded += stats->decoded;
+		sum.first_byte_nanos += stats->first_byte_nanos;
+		sum.last_byte_nanos += stats->last_byte_nanos;
+	}
+	return sum;
+}
+
+static decode_stats StatsSince(decode_stats start){
+	decode_stats now = SumStats();
+	return (decode_stats){
+		.blocks = now.blocks - start.blocks, .bytes = now.bytes - start.bytes,
+		.decode_cycles = now.decode_cycles - start.decode_cycles, .verify_cycles = now.verify_cycles - start.verify_cycles,
+		.decoded = now.decoded - start.decoded,
+		.first_byte_nanos = now.first_byte_nanos - start.first_byte_nanos, .last_byte_nanos = now.last_byte_nanos - start.last_byte_nanos,
+	};
+}
+
+static uint64_t Random(uint64_t* state){
+	// splitmix64
+	uint64_t z = (*state += 0x9E3779B97F4A7C15);
+	z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9;
+	z = (z ^ (z >> 27))*0x94D049BB133111EB;
+	return z ^ (z >> 31);
+}
+
+// Parse an access pattern such as "zipf:1.2" or "streams:8". Returns false if it isn't valid.
+static bool ParseAccess(const char* str, access_pattern* pattern){
+	for(access_kind kind = 0; kind < ACCESS_KIND_COUNT; kind++){
+		size_t len = strlen(ACCESS_NAMES[kind]);
+		if(strncmp(str, ACCESS_NAMES[kind], len) != 0 || (str[len] != '\0' && str[len] != ':')) continue;
+		
+		const char* arg = (str[len] == ':' ? str + len + 1 : NULL);
+		(*pattern) = (access_pattern){.kind = kind, .count = 1, .exponent = 1};
+		if(kind == ACCESS_STRIDE || kind == ACCESS_STREAMS){
+			if(arg) pattern->count = strtoul(arg, NULL, 0);
+			return arg && pattern->count > 0;
+		} else if(kind == ACCESS_ZIPF && arg){
+			pattern->exponent = strtod(arg, NULL);
+			return pattern->exponent > 0;
+		}
+		return arg == NULL;
+	}
+	return false;
+}
+
+// Fill 'order' with the block index of each of 'count' reads. Random patterns use a fixed seed so runs are comparable.
+static unsigned Gcd(unsigned a, unsigned b){
+	while(b){
+		unsigned r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+static void AccessOrder(const access_pattern* pattern, unsigned* order, unsigned count, unsigned block_count){
+	// Nothing to read. main() rejects empty archives, so 'count' is 0 as well.
+	if(block_count == 0) return;
+	
+	// Stepping by a stride coprime to the block count visits every block. Start from 61 so neighbours are far apart.
+	unsigned stride = 61;
+	while(Gcd(stride, block_count) != 1) stride++;
+	
+	double* cdf = NULL;
+	if(pattern->kind == ACCESS_ZIPF){
+		// The k-th most popular block is read in proportion to 1/k^s.
+		cdf = malloc(block_count*sizeof(double));
+		double sum = 0;
+		for(unsigned k = 0; k < block_count; k++) cdf[k] = (sum += pow(k + 1, -pattern->exponent));
+		for(unsigned k = 0; k < block_count; k++) cdf[k] /= sum;
+	}
+	
+	uint64_t rng = 1;
+	for(unsigned i = 0; i < count; i++){
+		switch(pattern->kind){
+			case ACCESS_SCATTER: order[i] = ((uint64_t)stride*i) % block_count; break;
+			case ACCESS_SEQUENTIAL: order[i] = i % block_count; break;
+			case ACCESS_STRIDE: {
+				// Shift by a block each time the stride wraps so every block is eventually read.
+				uint64_t pos = (uint64_t)i*pattern->count;
+				order[i] = (pos + pos/block_count) % block_count;
+			} break;
+			case ACCESS_UNIFORM: order[i] = Random(&rng) % block_count; break;
+			case ACCESS_ZIPF: {
+				double u = (Random(&rng) >> 11)*0x1.0p-53;
+				unsigned lo = 0, hi = block_count - 1;
+				while(lo < hi){
+					unsigned mid = (lo + hi)/2;
+					if(cdf[mid] < u) lo = mid + 1; else hi = mid;
+				}
+				// Spread the hot set through the archive instead of packing it at the start.
+				order[i] = ((uint64_t)stride*lo) % block_count;
+			} break;
+			case ACCESS_STREAMS: {
+				// Interleave sequential streams that start evenly spaced through the archive.
+				unsigned stream = i % pattern->count, step = i/pattern->count;
+				order[i] = ((uint64_t)stream*block_count/pattern->count + step) % block_count;
+			} break;
+			default: abort();
+		}
+	}
+	free(cdf);
+}
+
+static int CompareCountsDescending(const void* a, const void* b){
+	unsigned x = *(const unsigned*)a, y = *(const unsigned*)b;
+	return (x < y) - (x > y);
+}
+
+// Print how many distinct blocks the pattern reads, and how concentrated the reads are.
+static void AccessReport(const access_pattern* pattern, unsigned block_count, unsigned job_count){
+	unsigned* order = malloc(job_count*sizeof(unsigned));
+	unsigned* counts = calloc(block_count, sizeof(unsigned));
+	AccessOrder(pattern, order, job_count, block_count);
+	for(unsigned i = 0; i < job_count; i++) counts[order[i]]++;
+	qsort(counts, block_count, sizeof(unsigned), CompareCountsDescending);
+	
+	unsigned distinct = 0, hot = (block_count + 99)/100, hot_reads = 0;
+	for(unsigned i = 0; i < block_count; i++){
+		distinct += (counts[i] > 0);
+		if(i < hot) hot_reads += counts[i];
+	}
+	
+	printf("access %s", ACCESS_NAMES[pattern->kind]);
+	if(pattern->kind == ACCESS_STRIDE || pattern->kind == ACCESS_STREAMS) printf(" %u", pattern->count);
+	if(pattern->kind == ACCESS_ZIPF) printf(" %.2f", pattern->exponent);
+	printf(": %u distinct blocks, the hottest 1%% take %.1f%% of reads\n", distinct, 100.0*hot_reads/job_count);
+	
+	free(order);
+	free(counts);
+}
+
+// Decode 'job_count' blocks in the order set by ACCESS, wrapping around 'blocks' as needed.
+static uint64_t RunParallel(const block_ref* blocks, unsigned block_count, unsigned job_count){
+	unsigned* order = malloc(job_count*sizeof(unsigned));
+	AccessOrder(&ACCESS, order, job_count, block_count);
+	
 	// Setup jobs.
-	tina_job_description descs[BLOCK_COUNT];
-	for(unsigned i = 0; i < BLOCK_COUNT; i++){
-		unsigned idx = (61*i) & (BLOCK_COUNT - 1);
-		descs[i] = (tina_job_description){.func = BlockJob, .user_data = DATA + idx*DATA_LENGTH};
+	tina_job_description descs[job_count];
+	block_request* requests = malloc(job_count*sizeof(block_request));
+	for(unsigned i = 0; i < job_count; i++){
+		requests[i] = (block_request){.block = blocks + order[i]};
+		descs[i] = (tina_job_description){.name = "BlockJob", .func = BlockJob, .user_data = requests + i, .stack_size = HEAVY_STACK_SIZE};
+	}
+	free(order);
+	job_list jobs = {.descs = descs, .requests = requests, .count = job_count};
+	
+	bool fan_out = false;
+	for(unsigned i = 0; i < block_count; i++) fan_out |= (blocks[i].chunk_count > 1);
+	
+	// Jobs blocked on a full channel, waiting for their chunks or reading keep their fibers, so the window can't exceed the fibers set aside for it.
+	unsigned max_window = (PIPELINE || fan_out || IO != IO_MMAP ? MAX_WINDOW : JOB_COUNT/2);
+	// Each block in flight may also have a window of chunks queued.
+	if(fan_out && max_window > JOB_COUNT/(CHUNK_WINDOW + 2)) max_window = JOB_COUNT/(CHUNK_WINDOW + 2);
+	if(FIXED_WINDOW){
+		ThrottleInit(&THROTTLE, FIXED_WINDOW < max_window ? FIXED_WINDOW : max_window, max_window, false);
+	} else {
+		ThrottleInit(&THROTTLE, WORKER_COUNT < max_window ? WORKER_COUNT : max_window, max_window, true);
 	}
 	
 	tina_group group;
 	tina_group_init(&group);
-	tina_scheduler_enqueue(SCHED, NULL, RunJobs, descs, 0, &group);
+	
+	size_t consumed = 0;
+	unsigned capacity = 1;
+	if(PIPELINE){
+		// Round the capacity up to a power of two.
+		while(capacity < WORKER_COUNT) capacity *= 2;
+		CHANNEL = tina_channel_new(SCHED, capacity);
+		tina_scheduler_enqueue(SCHED, "ConsumeJob", ConsumeJob, &consumed, QUEUE_WORK, &group);
+	}
+	tina_scheduler_enqueue(SCHED, "RunJobs", RunJobs, &jobs, QUEUE_WORK, &group);
 	
 	// Wait for jobs to finish.
 	u_int64_t t0 = GetNanos();
 	tina_scheduler_wait_blocking(SCHED, &group, 0);
-	return GetNanos() - t0;
+	u_int64_t nanos = GetNanos() - t0;
+	
+	if(CHANNEL){
+		assert(consumed == job_count);
+		printf("Consumed %zu blocks through a channel with %u slots.\n", consumed, capacity);
+		tina_channel_free(CHANNEL);
+		CHANNEL = NULL;
+	}
+	
+	free(requests);
+	return nanos;
+}
+
+typedef struct {
+	const void* src;
+	size_t src_size;
+	void* dst;
+	size_t dst_size;
+	codec_id codec;
+	size_t size;
+} compress_task;
+
+static void CompressJob(tina_job* job, void* user_data, unsigned* thread_id){
+	compress_task* task = user_data;
+	task->size = CodecCompress(WORKERS[*thread_id].codec_ctx, task->codec, task->dst, task->dst_size, task->src, task->src_size);
+	assert(task->size > 0);
+}
+
+// Decode a whole block on the calling thread, chunk by chunk if it was split.
+static void DecodeRaw(codec_context* ctx, const block_ref* block, uint8_t* dst){
+	if(block->chunk_count == 0){
+		size_t size = CodecDecompress(ctx, block->codec, dst, block->raw_size, block->data, block->size);
+		assert(size == block->raw_size);
+		return;
+	}
+	
+	const uint8_t* src = block->data;
+	for(unsigned i = 0; i < block->chunk_count; i++){
+		size_t offset = (size_t)i*block->chunk_size;
+		size_t raw_size = (block->raw_size - offset < block->chunk_size ? block->raw_size - offset : block->chunk_size);
+		size_t size = CodecDecompress(ctx, block->codec, dst + offset, raw_size, src, block->chunks[i].size);
+		assert(size == raw_size);
+		src += block->chunks[i].size;
+	}
+}
+
+// Recompress a sample of the blocks with each codec, then decode the same number of blocks as the main run from each.
+static void RunCodecComparison(const block_ref* blocks, unsigned block_count){
+	unsigned sample_count = block_count < CODEC_SAMPLE_BLOCKS ? block_count : CODEC_SAMPLE_BLOCKS;
+	
+	// Decode the sample once to get the raw data.
+	codec_context* ctx = CodecContextNew();
+	CodecContextSetDictionary(ctx, DICTIONARY);
+	uint8_t* raw = malloc((size_t)sample_count*BLOCK_SIZE);
+	for(unsigned i = 0; i < sample_count; i++) DecodeRaw(ctx, blocks + i, raw + (size_t)i*BLOCK_SIZE);
+	CodecContextFree(ctx);
+	
+	printf("Comparing codecs on %u blocks (%u MB).\n", sample_count, (unsigned)(((size_t)sample_count*BLOCK_SIZE) >> 20));
+	printf("%8s %6s %8s %10s %12s %12s\n", "codec", "level", "ratio", "GB/s", "cycles/byte", "core-s/GB");
+	for(codec_id id = 0; id < CODEC_COUNT; id++){
+		size_t bound = CODECS[id].bound(BLOCK_SIZE);
+		uint8_t* packed = malloc(sample_count*bound);
+		
+		compress_task tasks[sample_count];
+		tina_job_description descs[sample_count];
+		for(unsigned i = 0; i < sample_count; i++){
+			tasks[i] = (compress_task){.src = raw + (size_t)i*BLOCK_SIZE, .src_size = blocks[i].raw_size, .dst = packed + i*bound, .dst_size = bound, .codec = id};
+			descs[i] = (tina_job_description){.name = "CompressJob", .func = CompressJob, .user_data = tasks + i, .stack_size = HEAVY_STACK_SIZE};
+		}
+		
+		tina_group group;
+		tina_group_init(&group);
+		tina_scheduler_enqueue_batch(SCHED, descs, sample_count, &group);
+		tina_scheduler_wait_blocking(SCHED, &group, 0);
+		
+		size_t raw_size = 0, packed_size = 0;
+		block_ref refs[sample_count];
+		for(unsigned i = 0; i < sample_count; i++){
+			refs[i] = blocks[i];
+			refs[i].data = tasks[i].dst;
+			refs[i].size = tasks[i].size;
+			refs[i].codec = id;
+			refs[i].key = BlockCacheKey(1 + id, i);
+			refs[i].chunks = NULL;
+			refs[i].chunk_count = 0;
+			raw_size += refs[i].raw_size;
+			packed_size += tasks[i].size;
+		}
+		
+		decode_stats start = SumStats();
+		cpu_usage cpu_start = GetCpuUsage();
+		uint64_t nanos = RunParallel(refs, sample_count, BLOCK_COUNT);
+		cpu_usage cpu_now = GetCpuUsage(), cpu = CpuUsageSince(&cpu_start, &cpu_now);
+		decode_stats stats = StatsSince(start);
+		
+		double ratio = (double)raw_size/packed_size;
+		double gbps = 1e9*stats.bytes/nanos/1024/1024/1024;
+		printf("%8s %6d %8.2f %10.2f %12.3f %12.3f\n",
+			CODECS[id].name, CODECS[id].level, ratio, gbps, (double)stats.decode_cycles/stats.bytes, CoreSecondsPerGB(&cpu, stats.bytes)
+		);
+		free(packed);
+	}
+	
+	free(raw);
+}
+
+static int CompareOffsets(const void* a, const void* b){
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+static unsigned CountUniquePayloads(const archive* ar){
+	unsigned count = ar->header.block_count;
+	uint64_t* offsets = malloc(count*sizeof(uint64_t));
+	for(unsigned i = 0; i < count; i++) offsets[i] = ar->entries[i].offset;
+	qsort(offsets, count, sizeof(uint64_t), CompareOffsets);
+	
+	unsigned unique = (count > 0);
+	for(unsigned i = 1; i < count; i++) unique += (offsets[i] != offsets[i - 1]);
+	free(offsets);
+	return unique;
+}
+
+// Time decoding one block at a time on an otherwise idle scheduler.
+static double MeasureBlockLatency(const block_ref* blocks, unsigned block_count){
+	// Bypass the cache so every block is really decoded.
+	block_cache* cache = CACHE;
+	CACHE = NULL;
+	
+	uint64_t total = 0;
+	unsigned count = block_count < LATENCY_SAMPLES ? block_count : LATENCY_SAMPLES;
+	for(unsigned i = 0; i < count; i++){
+		tina_group group;
+		tina_group_init(&group);
+		
+		uint64_t t0 = GetNanos();
+		block_request request = {.block = blocks + i*(block_count/count), .enqueue_nanos = t0};
+		tina_job_description desc = {.name = "BlockJob", .func = BlockJob, .user_data = &request, .stack_size = HEAVY_STACK_SIZE};
+		tina_scheduler_enqueue_batch(SCHED, &desc, 1, &group);
+		tina_scheduler_wait_blocking(SCHED, &group, 0);
+		total += GetNanos() - t0;
+	}
+	
+	CACHE = cache;
+	return (double)total/count;
+}
+
+// Decode a sample of the archive, then recompress and decode it again at each power of two block size.
+// Uses whichever codec most of the archive's blocks use.
+static void RunBlockSizeSweep(const block_ref* blocks, unsigned block_count){
+	unsigned codec_counts[CODEC_COUNT] = {0};
+	for(unsigned i = 0; i < block_count; i++) codec_counts[blocks[i].codec]++;
+	codec_id codec = CODEC_STORE;
+	for(codec_id id = 0; id < CODEC_COUNT; id++) if(codec_counts[id] > codec_counts[codec]) codec = id;
+	
+	// Gather the sample from the start of the archive so it's contiguous data.
+	codec_context* ctx = CodecContextNew();
+	CodecContextSetDictionary(ctx, DICTIONARY);
+	uint8_t* raw = malloc(SWEEP_SAMPLE_SIZE + BLOCK_SIZE);
+	size_t sample_size = 0;
+	for(unsigned i = 0; i < block_count && sample_size < SWEEP_SAMPLE_SIZE; i++){
+		DecodeRaw(ctx, blocks + i, raw + sample_size);
+		sample_size += blocks[i].raw_size;
+	}
+	if(sample_size > SWEEP_SAMPLE_SIZE) sample_size = SWEEP_SAMPLE_SIZE;
+	CodecContextFree(ctx);
+	
+	// DecodeBlock() sizes its buffers with BLOCK_SIZE, so it follows the sweep.
+	uint32_t archive_block_size = BLOCK_SIZE;
+	
+	printf("Sweeping block sizes on %zu MB with %s.\n", sample_size >> 20, CODECS[codec].name);
+	printf("%8s %8s %10s %12s %12s %12s %12s\n", "block KB", "ratio", "GB/s", "cycles/byte", "core-s/GB", "latency us", "TTFB us");
+	unsigned step = 0;
+	for(uint32_t block_size = SWEEP_MIN_BLOCK; block_size <= SWEEP_MAX_BLOCK; block_size *= 2, step++){
+		unsigned count = (sample_size + block_size - 1)/block_size;
+		size_t bound = CODECS[codec].bound(block_size);
+		uint8_t* packed = malloc(count*bound);
+		compress_task* tasks = malloc(count*sizeof(compress_task));
+		tina_job_description* descs = malloc(count*sizeof(tina_job_description));
+		for(unsigned i = 0; i < count; i++){
+			size_t offset = (size_t)i*block_size;
+			size_t raw_size = (sample_size - offset < block_size ? sample_size - offset : block_size);
+			tasks[i] = (compress_task){.src = raw + offset, .src_size = raw_size, .dst = packed + i*bound, .dst_size = bound, .codec = codec};
+			descs[i] = (tina_job_description){.name = "CompressJob", .func = CompressJob, .user_data = tasks + i, .stack_size = HEAVY_STACK_SIZE};
+		}
+		
+		// Small block sizes need more jobs than the scheduler holds at once.
+		tina_group group;
+		tina_group_init(&group);
+		for(unsigned cursor = 0; cursor < count;){
+			cursor += tina_scheduler_enqueue_throttled(SCHED, descs + cursor, count - cursor, &group, JOB_COUNT/2);
+			tina_scheduler_wait_blocking(SCHED, &group, JOB_COUNT/4);
+		}
+		tina_scheduler_wait_blocking(SCHED, &group, 0);
+		
+		size_t packed_size = 0;
+		block_ref* refs = malloc(count*sizeof(block_ref));
+		for(unsigned i = 0; i < count; i++){
+			refs[i] = (block_ref){
+				.key = BlockCacheKey(1 + CODEC_COUNT + step, i), .data = tasks[i].dst, .size = tasks[i].size,
+				.raw_size = tasks[i].src_size, .checksum = Crc32c(0, tasks[i].src, tasks[i].src_size), .codec = codec,
+			};
+			packed_size += tasks[i].size;
+		}
+		
+		BLOCK_SIZE = block_size;
+		unsigned job_count = SWEEP_DECODE_SIZE/block_size;
+		if(job_count < count) job_count = count;
+		
+		decode_stats start = SumStats();
+		cpu_usage cpu_start = GetCpuUsage();
+		uint64_t nanos = RunParallel(refs, count, job_count);
+		cpu_usage cpu_now = GetCpuUsage(), cpu = CpuUsageSince(&cpu_start, &cpu_now);
+		decode_stats stats = StatsSince(start);
+		double latency = MeasureBlockLatency(refs, count);
+		
+		double ratio = (double)sample_size/packed_size;
+		double gbps = 1e9*stats.bytes/nanos/1024/1024/1024;
+		double ttfb = (stats.decoded ? stats.first_byte_nanos/1e3/stats.decoded : 0);
+		printf("%8u %8.2f %10.2f %12.3f %12.3f %12.1f %12.1f\n",
+			block_size >> 10, ratio, gbps, (double)stats.decode_cycles/stats.bytes, CoreSecondsPerGB(&cpu, stats.bytes), latency/1e3, ttfb
+		);
+		
+		free(packed);
+		free(tasks);
+		free(descs);
+		free(refs);
+	}
+	
+	BLOCK_SIZE = archive_block_size;
+	free(raw);
+}
+
+static void LatencyReset(void){
+	for(unsigned i = 0; i < WORKER_COUNT; i++) memset(WORKERS[i].latency, 0, sizeof(WORKERS[i].latency));
+}
+
+// Combine the workers' histograms for each stage. Free the result when done.
+static histogram* LatencyMerge(void){
+	histogram* merged = calloc(STAGE_COUNT, sizeof(histogram));
+	for(unsigned i = 0; i < WORKER_COUNT; i++){
+		for(unsigned stage = 0; stage < STAGE_COUNT; stage++) HistogramMerge(merged + stage, WORKERS[i].latency + stage);
+	}
+	return merged;
+}
+
+// Headline numbers of a run, written with -J for the regression gate in 'make bench'.
+typedef struct {
+	double gbps, core_seconds_per_gb, p99_us;
+	// The run couldn't happen here, such as when the I/O backend is unavailable.
+	bool skipped;
+} bench_result;
+
+// Append a result as one line of JSON. benchcmp reads this exact format back.
+static void WriteBenchResult(const char* path, const char* name, const bench_result* result){
+	FILE* file = fopen(path, "a");
+	if(!file){
+		fprintf(stderr, "Could not open %s for writing.\n", path);
+		exit(EXIT_FAILURE);
+	}
+	
+	if(result->skipped){
+		fprintf(file, "{\"name\": \"%s\", \"skipped\": true}\n", name);
+	} else {
+		fprintf(file, "{\"name\": \"%s\", \"gbps\": %.4f, \"core_s_per_gb\": %.4f, \"p99_us\": %.1f}\n",
+			name, result->gbps, result->core_seconds_per_gb, result->p99_us
+		);
+	}
+	fclose(file);
+}
+
+// Two sided 95% Student's t values, indexed by degrees of freedom - 1.
+static const double T_95[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static int CompareDoubles(const void* a, const void* b){
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// Sorts 'values' in place.
+static double Median(double* values, unsigned count){
+	qsort(values, count, sizeof(double), CompareDoubles);
+	return (count % 2 ? values[count/2] : (values[count/2 - 1] + values[count/2])/2);
+}
+
+// Print the spread of trial times, and return the median. 'bytes' is the decompressed size read by each trial.
+static double TrialReport(const char* label, double* millis, unsigned count, uint64_t bytes){
+	double median = Median(millis, count);
+	double mean = 0, variance = 0;
+	for(unsigned i = 0; i < count; i++) mean += millis[i]/count;
+	for(unsigned i = 0; i < count; i++) variance += (millis[i] - mean)*(millis[i] - mean);
+	
+	double ci = 0;
+	if(count > 1){
+		double t = (count - 1 <= sizeof(T_95)/sizeof(*T_95) ? T_95[count - 2] : 1.96);
+		ci = t*sqrt(variance/(count - 1)/count);
+	}
+	
+	double p95 = millis[(unsigned)ceil(0.95*count) - 1];
+	printf("%s: min %.1f, median %.1f, p95 %.1f, mean %.1f +/- %.1f ms (95%% CI), %.2f GB/s at the median\n",
+		label, millis[0], median, p95, mean, ci, 1e3*bytes/median/1024/1024/1024
+	);
+	return median;
 }
 
-int main(void){
+// Empty the block cache and drop the archive from the page cache.
+static void EvictCaches(void){
+	if(CACHE) BlockCacheClear(CACHE);
+	ArchiveEvict(ARCHIVE);
+	
+	// If the kernel kept the pages anyway, drop the whole page cache. This only works as root.
+	if(ArchiveResidency(ARCHIVE) > 0.01){
+		FILE* file = fopen("/proc/sys/vm/drop_caches", "w");
+		if(file){
+			fputs("1", file);
+			fclose(file);
+		}
+	}
+}
+
+// Repeat the main run and report the spread of the times.
+// Cold trials start with the archive evicted from the page cache and an empty block cache, and are followed by a warm trial.
+// The medians of the warm trials' throughput, CPU use and p99 latency go into 'result', so one noisy trial can't move them.
+static void RunTrials(const block_ref* blocks, unsigned count, bool cold, bench_result* result){
+	double* cold_millis = malloc(count*sizeof(double));
+	double* warm_millis = malloc(count*sizeof(double));
+	double* warm_cpu = malloc(count*sizeof(double));
+	double* warm_p99 = malloc(count*sizeof(double));
+	uint64_t bytes = 0;
+	
+	// Otherwise the first trial would pull the archive into the page cache.
+	if(!cold) RunParallel(blocks, BLOCK_COUNT, BLOCK_COUNT);
+	
+	printf("%6s %10s %10s %10s\n", "trial", "resident", "cold ms", "warm ms");
+	for(unsigned i = 0; i < count; i++){
+		if(cold){
+			EvictCaches();
+			double resident = ArchiveResidency(ARCHIVE);
+			cold_millis[i] = RunParallel(blocks, BLOCK_COUNT, BLOCK_COUNT)/1e6;
+			printf("%6u %9.1f%% %10.1f ", i, 100*resident, cold_millis[i]);
+		} else {
+			printf("%6u %10s %10s ", i, "", "");
+		}
+		
+		LatencyReset();
+		decode_stats start = SumStats();
+		cpu_usage cpu_start = GetCpuUsage();
+		warm_millis[i] = RunParallel(blocks, BLOCK_COUNT, BLOCK_COUNT)/1e6;
+		cpu_usage cpu_now = GetCpuUsage(), cpu = CpuUsageSince(&cpu_start, &cpu_now);
+		bytes = StatsSince(start).bytes;
+		printf("%10.1f\n", warm_millis[i]);
+		
+		warm_cpu[i] = CoreSecondsPerGB(&cpu, bytes);
+		histogram* merged = LatencyMerge();
+		warm_p99[i] = HistogramPercentile(merged + STAGE_TOTAL, 99)/1e3;
+		free(merged);
+	}
+	
+	if(cold) TrialReport("cold", cold_millis, count, bytes);
+	double median = TrialReport("warm", warm_millis, count, bytes);
+	(*result) = (bench_result){
+		.gbps = 1e3*bytes/median/1024/1024/1024,
+		.core_seconds_per_gb = Median(warm_cpu, count),
+		.p99_us = Median(warm_p99, count),
+	};
+	
+	free(cold_millis);
+	free(warm_millis);
+	free(warm_cpu);
+	free(warm_p99);
+}
+
+// Print percentiles of each stage's latency, and optionally write the histograms to a CSV file.
+static void LatencyReport(const char* csv_path){
+	histogram* merged = LatencyMerge();
+	
+	printf("%8s %10s %10s %10s %10s %10s\n", "latency", "count", "p50 us", "p99 us", "p99.9 us", "max us");
+	for(unsigned stage = 0; stage < STAGE_COUNT; stage++){
+		const histogram* h = merged + stage;
+		printf("%8s %10"PRIu64" %10.1f %10.1f %10.1f %10.1f\n", STAGE_NAMES[stage], h->total,
+			HistogramPercentile(h, 50)/1e3, HistogramPercentile(h, 99)/1e3, HistogramPercentile(h, 99.9)/1e3, h->max/1e3
+		);
+	}
+	
+	if(csv_path){
+		FILE* file = fopen(csv_path, "w");
+		if(file){
+			fprintf(file, "stage,lower_ns,upper_ns,count\n");
+			for(unsigned stage = 0; stage < STAGE_COUNT; stage++) HistogramWriteCSV(merged + stage, STAGE_NAMES[stage], file);
+			fclose(file);
+			printf("Wrote latency histograms to %s.\n", csv_path);
+		} else {
+			fprintf(stderr, "Could not open %s for writing.\n", csv_path);
+		}
+	}
+	
+	free(merged);
+}
+
+// Rerun the main workload with 1, 2, 4 ... workers, at each in-flight depth, to show where throughput stops scaling.
+// A depth of 0 uses the adaptive window. Each row is also written to a CSV file.
+static void RunThreadSweep(const block_ref* blocks, const unsigned* depths, unsigned depth_count, const char* csv_path){
+	FILE* file = fopen(csv_path, "w");
+	if(!file){
+		fprintf(stderr, "Could not open %s for writing.\n", csv_path);
+		return;
+	}
+	fprintf(file, "workers,depth,window,seconds,gb_per_sec,blocks_per_sec,user_seconds,sys_seconds,cores_busy,core_seconds_per_gb,"
+		"cycles_per_byte,instructions_per_byte,cache_misses_per_kb,p50_us,p99_us,p999_us\n"
+	);
+	
+	unsigned fixed_window = FIXED_WINDOW;
+	double* single_gbps = calloc(depth_count, sizeof(double));
+	
+	// Warm up the page cache so the first row isn't penalized.
+	RunParallel(blocks, BLOCK_COUNT, BLOCK_COUNT);
+	
+	printf("%8s %8s %8s %10s %8s %8s %10s %10s %10s\n", "workers", "depth", "window", "GB/s", "speedup", "cores", "core-s/GB", "p50 us", "p99 us");
+	for(unsigned count = 1;; count = (2*count < MAX_WORKER_COUNT ? 2*count : MAX_WORKER_COUNT)){
+		SetWorkerCount(count);
+		for(unsigned i = 0; i < depth_count; i++){
+			FIXED_WINDOW = depths[i];
+			LatencyReset();
+			decode_stats start = SumStats();
+			cpu_usage cpu_start = GetCpuUsage();
+			uint64_t nanos = RunParallel(blocks, BLOCK_COUNT, BLOCK_COUNT);
+			cpu_usage cpu_now = GetCpuUsage(), cpu = CpuUsageSince(&cpu_start, &cpu_now);
+			decode_stats stats = StatsSince(start);
+			
+			histogram* merged = LatencyMerge();
+			const histogram* total = merged + STAGE_TOTAL;
+			double p50 = HistogramPercentile(total, 50)/1e3, p99 = HistogramPercentile(total, 99)/1e3, p999 = HistogramPercentile(total, 99.9)/1e3;
+			free(merged);
+			
+			double seconds = nanos/1e9;
+			double gbps = stats.bytes/seconds/1024/1024/1024;
+			double cores = (cpu.user_seconds + cpu.sys_seconds)/seconds;
+			if(count == 1) single_gbps[i] = gbps;
+			
+			char depth[16] = "auto";
+			if(depths[i]) snprintf(depth, sizeof(depth), "%u", depths[i]);
+			printf("%8u %8s %8u %10.2f %8.2f %8.2f %10.3f %10.1f %10.1f\n",
+				count, depth, THROTTLE.window, gbps, gbps/single_gbps[i], cores, CoreSecondsPerGB(&cpu, stats.bytes), p50, p99
+			);
+			
+			fprintf(file, "%u,%s,%u,%.6f,%.4f,%.1f,%.4f,%.4f,%.3f,%.4f,", count, depth, THROTTLE.window, seconds, gbps, BLOCK_COUNT/seconds,
+				cpu.user_seconds, cpu.sys_seconds, cores, CoreSecondsPerGB(&cpu, stats.bytes)
+			);
+			if(HW_COUNTERS){
+				fprintf(file, "%.4f,%.4f,%.4f,", (double)cpu.cycles/stats.bytes, (double)cpu.instructions/stats.bytes, 1024.0*cpu.cache_misses/stats.bytes);
+			} else {
+				fprintf(file, ",,,");
+			}
+			fprintf(file, "%.1f,%.1f,%.1f\n", p50, p99, p999);
+		}
+		
+		if(count == MAX_WORKER_COUNT) break;
+	}
+	
+	FIXED_WINDOW = fixed_window;
+	free(single_gbps);
+	fclose(file);
+	printf("Wrote thread scaling results to %s.\n", csv_path);
+}
+
+static bool IoAvailable(io_kind io){
+	if(io == IO_URING) return RING != NULL;
+	if(io == IO_DIRECT) return DIRECT_FD >= 0;
+	return true;
+}
+
+// Run the main workload once with each I/O backend. Cold runs evict the archive from the page cache first.
+static void RunIoComparison(const block_ref* blocks, bool cold){
+	io_kind io = IO;
+	
+	// Otherwise the first backend would pull the archive into the page cache.
+	if(!cold) RunParallel(blocks, BLOCK_COUNT, BLOCK_COUNT);
+	
+	printf("Comparing I/O backends with a %s page cache.\n", cold ? "cold" : "warm");
+	printf("%8s %10s %10s %10s %10s %10s\n", "backend", "GB/s", "core-s/GB", "io p50 us", "io p99 us", "p99 us");
+	for(io_kind kind = 0; kind < IO_KIND_COUNT; kind++){
+		if(!IoAvailable(kind)){
+			printf("%8s unavailable\n", IO_NAMES[kind]);
+			continue;
+		}
+		
+		IO = kind;
+		if(cold) EvictCaches();
+		LatencyReset();
+		decode_stats start = SumStats();
+		cpu_usage cpu_start = GetCpuUsage();
+		uint64_t nanos = RunParallel(blocks, BLOCK_COUNT, BLOCK_COUNT);
+		cpu_usage cpu_now = GetCpuUsage(), cpu = CpuUsageSince(&cpu_start, &cpu_now);
+		decode_stats stats = StatsSince(start);
+		
+		histogram* merged = LatencyMerge();
+		printf("%8s %10.2f %10.3f %10.1f %10.1f %10.1f\n", IO_NAMES[kind],
+			1e9*stats.bytes/nanos/1024/1024/1024, CoreSecondsPerGB(&cpu, stats.bytes),
+			HistogramPercentile(merged + STAGE_IO, 50)/1e3, HistogramPercentile(merged + STAGE_IO, 99)/1e3,
+			HistogramPercentile(merged + STAGE_TOTAL, 99)/1e3
+		);
+		free(merged);
+	}
+	
+	IO = io;
+}
+
+static void CacheReport(void){
+	if(!CACHE) return;
+	
+	block_cache_stats stats;
+	BlockCacheGetStats(CACHE, &stats);
+	double lookups = stats.hits + stats.misses;
+	printf("cache: %.1f%% hits (%"PRIu64" hits, %"PRIu64" misses, %"PRIu64" evictions), %zu MB resident\n",
+		100*stats.hits/lookups, stats.hits, stats.misses, stats.evictions, stats.bytes >> 20
+	);
+	printf("cache: saved %.1f ms of decompression\n", stats.saved_nanos/1e6);
+}
+
+int main(int argc, char* argv[]){
+	int opt;
+	bool compare_codecs = false, sweep_block_sizes = false, cold = false, compare_io = false;
+	size_t cache_mb = 0;
+	unsigned trial_count = 1, worker_count = 0;
+	const char* latency_path = NULL;
+	const char* scaling_path = NULL;
+	const char* bench_path = NULL;
+	const char* access_name = "scatter";
+	unsigned depths[MAX_SWEEP_DEPTHS], depth_count = 0;
+	while((opt = getopt(argc, argv, "t:w:pcBm:s:a:n:CH:j:S:d:i:IJ:")) != -1){
+		switch(opt){
+			case 't': TRACE_PATH = optarg; break;
+			case 'w': FIXED_WINDOW = strtoul(optarg, NULL, 0); break;
+			case 'p': PIPELINE = true; break;
+			case 'c': compare_codecs = true; break;
+			case 'B': sweep_block_sizes = true; break;
+			case 'm': cache_mb = strtoul(optarg, NULL, 0); break;
+			case 's': PROGRESS_STEP = strtoul(optarg, NULL, 0); break;
+			case 'n': trial_count = strtoul(optarg, NULL, 0); break;
+			case 'C': cold = true; break;
+			case 'H': latency_path = optarg; break;
+			case 'j': worker_count = strtoul(optarg, NULL, 0); break;
+			case 'S': scaling_path = optarg; break;
+			case 'i':
+				for(IO = 0; IO < IO_KIND_COUNT && strcmp(optarg, IO_NAMES[IO]) != 0; IO++);
+				if(IO < IO_KIND_COUNT) break;
+				fprintf(stderr, "Unknown I/O backend %s. Use mmap, pread, preadv2, uring or direct.\n", optarg);
+				return EXIT_FAILURE;
+			case 'I': compare_io = true; break;
+			case 'J': bench_path = optarg; break;
+			case 'd':
+				for(char* depth = strtok(optarg, ","); depth && depth_count < MAX_SWEEP_DEPTHS; depth = strtok(NULL, ",")){
+					depths[depth_count++] = strtoul(depth, NULL, 0);
+				}
+				break;
+			case 'a':
+				access_name = optarg;
+				if(ParseAccess(optarg, &ACCESS)) break;
+				// fallthrough
+			default:
+				fprintf(stderr, "Usage: %s [-t trace.json] [-w fixed_window] [-p] [-c] [-B] [-m cache_mb] [-s progress_step] [-a access] [-n trials] [-C] [-H latency.csv] [-j workers] [-S scaling.csv] [-d depth,depth...] [-i io] [-I] [-J results.json] [archive]\n", argv[0]);
+				fprintf(stderr, "Access patterns: scatter (default), sequential, stride:blocks, uniform, zipf[:exponent], streams:count\n");
+				fprintf(stderr, "-S sweeps the worker count up to -j, at each in-flight depth given by -d (0 is adaptive).\n");
+				fprintf(stderr, "I/O backends: mmap (default), pread, preadv2, uring, direct. -I compares them all.\n");
+				fprintf(stderr, "-J appends the main run's throughput, CPU use and p99 latency to a JSON lines file.\n");
+				return EXIT_FAILURE;
+		}
+	}
+	const char* path = (optind < argc ? argv[optind] : "data.pak");
+	
 	// Map data.
-	int fd = open("data15", 0);
-	struct stat stats;
-	fstat(fd, &stats);
-	
-	BLOCK_COUNT = stats.st_size/DATA_LENGTH;
-	assert(stats.st_size % DATA_LENGTH == 0);
-	
-	DATA = mmap(NULL, stats.st_size, PROT_READ, MAP_SHARED, fd, 0);
-	assert(DATA);
-	madvise(DATA, stats.st_size, MADV_SEQUENTIAL);
-	
-	// uint64_t nanos = RunSequentialSingle();
-	uint64_t nanos = RunRandomParallel();
-	printf("read %"PRIu64" MB (%d blocks) in %"PRIu64" ms\n", stats.st_size >> 20, BLOCK_COUNT, nanos/1000000);
-	printf("%.2f GB/s raw\n", 1e9*stats.st_size/nanos/1024/1024/1024);
-	printf("%.2f GB/s lz4\n", 1e9*((size_t)BLOCK_SIZE*(size_t)BLOCK_COUNT)/nanos/1024/1024/1024);
+	ARCHIVE = ArchiveOpen(path);
+	if(!ARCHIVE) return EXIT_FAILURE;
+	BLOCK_SIZE = ARCHIVE->header.block_size;
+	printf("%s: %u blocks of %u KB.\n", path, (unsigned)ARCHIVE->header.block_count, BLOCK_SIZE >> 10);
+	
+	if(ArchiveDictionary(ARCHIVE)){
+		DICTIONARY = CodecDictionaryNew(ArchiveDictionary(ARCHIVE), ARCHIVE->header.dict_size);
+		printf("Using a %u KB dictionary.\n", ARCHIVE->header.dict_size >> 10);
+	}
+	
+	BLOCK_COUNT = ARCHIVE->header.block_count;
+	if(BLOCK_COUNT == 0){
+		fprintf(stderr, "%s has no blocks to decode.\n", path);
+		return EXIT_FAILURE;
+	}
+	madvise((void*)ARCHIVE->data, ARCHIVE->size, MADV_SEQUENTIAL);
+	
+	// Either can be missing, O_DIRECT on tmpfs for example.
+	RING = UringNew(URING_ENTRIES);
+	DIRECT_FD = open(path, O_RDONLY | O_DIRECT);
+	if(!IoAvailable(IO)){
+		fprintf(stderr, "The %s I/O backend isn't available here.\n", IO_NAMES[IO]);
+		if(!bench_path) return EXIT_FAILURE;
+		
+		// Record the skip so the regression gate doesn't count a missing backend as a regression.
+		char name[256];
+		snprintf(name, sizeof(name), "%s/%s", access_name, IO_NAMES[IO]);
+		WriteBenchResult(bench_path, name, &(bench_result){.skipped = true});
+		printf("Appended %s to %s as skipped.\n", name, bench_path);
+		return EXIT_SUCCESS;
+	}
+	if(IO != IO_MMAP) printf("Reading blocks with %s.\n", IO_NAMES[IO]);
+	
+	// Deduplicated blocks share a payload, so key the cache by payload offset.
+	// A block that's already been decoded through another index entry is then a cache hit.
+	size_t packed_size = 0;
+	block_ref* blocks = malloc(BLOCK_COUNT*sizeof(block_ref));
+	for(unsigned i = 0; i < BLOCK_COUNT; i++){
+		const archive_entry* entry = ARCHIVE->entries + i;
+		blocks[i] = (block_ref){
+			.key = BlockCacheKey(0, entry->offset), .data = ArchivePayload(ARCHIVE, i), .size = entry->size,
+			.raw_size = entry->raw_size, .checksum = entry->checksum, .codec = entry->codec,
+			.chunks = ArchiveChunks(ARCHIVE, i), .chunk_size = ARCHIVE->header.chunk_size,
+			.chunk_count = ArchiveChunkCount(ARCHIVE->header.chunk_size, entry->raw_size),
+		};
+		packed_size += entry->size;
+	}
+	
+	unsigned unique_count = CountUniquePayloads(ARCHIVE);
+	if(unique_count < BLOCK_COUNT) printf("%u blocks share %u unique payloads.\n", BLOCK_COUNT, unique_count);
+	
+	StartWorkers(worker_count);
+	
+	if(cache_mb){
+		CACHE = BlockCacheNew(cache_mb << 20, CACHE_STRIPES);
+		printf("Caching up to %zu MB of decompressed blocks.\n", cache_mb);
+	}
+	
+	tina_trace* trace = NULL;
+	if(TRACE_PATH){
+		trace = tina_trace_new(MAX_WORKER_COUNT + IO_THREAD_COUNT + 1, 1 << 16);
+		tina_scheduler_trace(SCHED, trace);
+	}
+	
+	bench_result result = {0};
+	bool have_result = false;
+	if(compare_codecs){
+		RunCodecComparison(blocks, BLOCK_COUNT);
+		CacheReport();
+	} else if(sweep_block_sizes){
+		RunBlockSizeSweep(blocks, BLOCK_COUNT);
+		CacheReport();
+	} else if(scaling_path){
+		if(depth_count == 0) depths[depth_count++] = FIXED_WINDOW;
+		AccessReport(&ACCESS, BLOCK_COUNT, BLOCK_COUNT);
+		RunThreadSweep(blocks, depths, depth_count, scaling_path);
+	} else if(compare_io){
+		AccessReport(&ACCESS, BLOCK_COUNT, BLOCK_COUNT);
+		RunIoComparison(blocks, cold);
+	} else if(trial_count > 1 || cold){
+		AccessReport(&ACCESS, BLOCK_COUNT, BLOCK_COUNT);
+		RunTrials(blocks, trial_count ? trial_count : 1, cold, &result);
+		have_result = true;
+		CacheReport();
+	} else {
+		AccessReport(&ACCESS, BLOCK_COUNT, BLOCK_COUNT);
+		
+		LatencyReset();
+		decode_stats start = SumStats();
+		cpu_usage cpu_start = GetCpuUsage();
+		uint64_t nanos = RunParallel(blocks, BLOCK_COUNT, BLOCK_COUNT);
+		cpu_usage cpu_now = GetCpuUsage(), cpu = CpuUsageSince(&cpu_start, &cpu_now);
+		decode_stats stats = StatsSince(start);
+		
+		printf("read %zu MB (%d blocks) in %"PRIu64" ms\n", packed_size >> 20, BLOCK_COUNT, nanos/1000000);
+		printf("%.2f GB/s raw\n", 1e9*packed_size/nanos/1024/1024/1024);
+		printf("%.2f GB/s decoded\n", 1e9*stats.bytes/nanos/1024/1024/1024);
+		printf("%.3f cycles/byte (%.3f decode, %.3f verify)\n",
+			(double)(stats.decode_cycles + stats.verify_cycles)/stats.bytes,
+			(double)stats.decode_cycles/stats.bytes, (double)stats.verify_cycles/stats.bytes
+		);
+		if(stats.decoded){
+			printf("time to first byte %.1f us, last byte %.1f us (mean per decoded block%s)\n",
+				stats.first_byte_nanos/1e3/stats.decoded, stats.last_byte_nanos/1e3/stats.decoded,
+				PROGRESS_STEP ? ", progressive" : ""
+			);
+		}
+		CpuReport(&cpu, stats.bytes, nanos);
+		CacheReport();
+		LatencyReport(latency_path);
+		
+		histogram* merged = LatencyMerge();
+		result = (bench_result){
+			.gbps = 1e9*stats.bytes/nanos/1024/1024/1024,
+			.core_seconds_per_gb = CoreSecondsPerGB(&cpu, stats.bytes),
+			.p99_us = HistogramPercentile(merged + STAGE_TOTAL, 99)/1e3,
+		};
+		have_result = true;
+		free(merged);
+		
+		double latency = MeasureBlockLatency(blocks, BLOCK_COUNT);
+		if(ARCHIVE->header.chunk_size){
+			printf("single block latency %.1f us (%u KB chunks)\n", latency/1e3, ARCHIVE->header.chunk_size >> 10);
+		} else {
+			printf("single block latency %.1f us\n", latency/1e3);
+		}
+		ThrottleReport(&THROTTLE);
+	}
+	
+	if(bench_path){
+		if(have_result){
+			char name[256];
+			snprintf(name, sizeof(name), "%s/%s", access_name, IO_NAMES[IO]);
+			WriteBenchResult(bench_path, name, &result);
+			printf("Appended %s to %s.\n", name, bench_path);
+		} else {
+			fprintf(stderr, "-J only records the main run or trials.\n");
+		}
+	}
+	
+	if(trace){
+		FILE* file = fopen(TRACE_PATH, "w");
+		if(file){
+			tina_trace_write_json(trace, file);
+			fclose(file);
+			printf("Wrote trace to %s.\n", TRACE_PATH);
+		} else {
+			fprintf(stderr, "Could not open %s for writing.\n", TRACE_PATH);
+		}
+		
+		// Detach it first since the workers are still running.
+		tina_scheduler_trace(SCHED, NULL);
+		tina_trace_free(trace);
+	}
 	
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include "tinycthread.h"
+
+#define TINA_IMPLEMENTATION
+#include "tina.h"
+
+#define TINA_JOBS_IMPLEMENTATION
+#include "tina_jobs.h"
+
+// Microbenchmarks for the cost of switching between coroutines and jobs.
+// The job benchmarks run on the main thread with tina_scheduler_run() in flush mode, so only the switching cost is measured.
+
+#if __aarch64__
+	#define ABI_NAME "aarch64"
+#elif __ARM_EABI__
+	#define ABI_NAME "arm32 EABI"
+#elif __amd64__ && (__unix__ || __APPLE__)
+	#define ABI_NAME "x86_64 SysV"
+#elif __WIN64__ || defined(_WIN64)
+	#define ABI_NAME "Win64"
+#else
+	#define ABI_NAME "unknown"
+#endif
+
+#define ROUND_TRIPS (1 << 20)
+#define THREAD_ROUND_TRIPS (1 << 16)
+#define STACK_SIZE (64*1024)
+
+#define JOB_COUNT 1024
+#define BATCH_SIZE 512
+#define EMPTY_JOBS (1 << 20)
+#define YIELD_JOBS 64
+#define YIELD_COUNT (1 << 14)
+#define PING_PONGS (1 << 18)
+
+static uint64_t GetNanos(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000*(uint64_t)ts.tv_sec + (uint64_t)ts.tv_nsec;
+}
+
+static uintptr_t EchoBody(tina* coro, uintptr_t value){
+	while(true) value = tina_yield(coro, value);
+	return 0;
+}
+
+static double BenchTina(bool no_fp){
+	tina* coro = tina_init(NULL, STACK_SIZE, EchoBody, NULL);
+	coro->no_fp = no_fp;
+	
+	uint64_t t0 = GetNanos();
+	for(unsigned i = 0; i < ROUND_TRIPS; i++) tina_yield(coro, i);
+	uint64_t nanos = GetNanos() - t0;
+	
+	free(coro->buffer);
+	return (double)nanos/ROUND_TRIPS;
+}
+
+static ucontext_t MAIN_CONTEXT, ECHO_CONTEXT;
+
+static void EchoContext(void){
+	while(true) swapcontext(&ECHO_CONTEXT, &MAIN_CONTEXT);
+}
+
+static double BenchUcontext(void){
+	void* stack = malloc(STACK_SIZE);
+	getcontext(&ECHO_CONTEXT);
+	ECHO_CONTEXT.uc_stack = (stack_t){.ss_sp = stack, .ss_size = STACK_SIZE};
+	ECHO_CONTEXT.uc_link = NULL;
+	makecontext(&ECHO_CONTEXT, EchoContext, 0);
+	
+	uint64_t t0 = GetNanos();
+	for(unsigned i = 0; i < ROUND_TRIPS; i++) swapcontext(&MAIN_CONTEXT, &ECHO_CONTEXT);
+	uint64_t nanos = GetNanos() - t0;
+	
+	free(stack);
+	return (double)nanos/ROUND_TRIPS;
+}
+
+// Two threads taking turns through a mutex and condition variable.
+typedef struct {
+	mtx_t lock;
+	cnd_t signal;
+	unsigned turn;
+} handoff_ctx;
+
+static int EchoThread(void* data){
+	handoff_ctx* ctx = data;
+	mtx_lock(&ctx->lock);
+	for(unsigned i = 0; i < THREAD_ROUND_TRIPS; i++){
+		while(ctx->turn != 1) cnd_wait(&ctx->signal, &ctx->lock);
+		ctx->turn = 0;
+		cnd_signal(&ctx->signal);
+	}
+	mtx_unlock(&ctx->lock);
+	return 0;
+}
+
+static double BenchThreads(void){
+	handoff_ctx ctx = {.turn = 0};
+	mtx_init(&ctx.lock, mtx_plain);
+	cnd_init(&ctx.signal);
+	
+	thrd_t thread;
+	thrd_create(&thread, EchoThread, &ctx);
+	
+	uint64_t t0 = GetNanos();
+	mtx_lock(&ctx.lock);
+	for(unsigned i = 0; i < THREAD_ROUND_TRIPS; i++){
+		ctx.turn = 1;
+		cnd_signal(&ctx.signal);
+		while(ctx.turn != 0) cnd_wait(&ctx.signal, &ctx.lock);
+	}
+	mtx_unlock(&ctx.lock);
+	uint64_t nanos = GetNanos() - t0;
+	
+	thrd_join(thread, NULL);
+	cnd_destroy(&ctx.signal);
+	mtx_destroy(&ctx.lock);
+	return (double)nanos/THREAD_ROUND_TRIPS;
+}
+
+static tina_scheduler* SCHED;
+// Mark the benchmark jobs as not using FP/SIMD registers.
+static bool NO_FP;
+
+static void EmptyJob(tina_job* job, void* user_data, unsigned* thread_id){}
+
+static double BenchEmpty(void){
+	tina_job_description descs[BATCH_SIZE];
+	for(unsigned i = 0; i < BATCH_SIZE; i++) descs[i] = (tina_job_description){.name = "EmptyJob", .func = EmptyJob, .no_fp = NO_FP};
+	
+	uint64_t t0 = GetNanos();
+	for(unsigned i = 0; i < EMPTY_JOBS; i += BATCH_SIZE){
+		tina_scheduler_enqueue_batch(SCHED, descs, BATCH_SIZE, NULL);
+		tina_scheduler_run(SCHED, 0, true, 0);
+	}
+	return (double)(GetNanos() - t0)/EMPTY_JOBS;
+}
+
+static void YieldJob(tina_job* job, void* user_data, unsigned* thread_id){
+	for(unsigned i = 0; i < YIELD_COUNT; i++) tina_job_yield(job);
+}
+
+static double BenchYield(void){
+	tina_job_description descs[YIELD_JOBS];
+	for(unsigned i = 0; i < YIELD_JOBS; i++) descs[i] = (tina_job_description){.name = "YieldJob", .func = YieldJob, .no_fp = NO_FP};
+	
+	uint64_t t0 = GetNanos();
+	tina_scheduler_enqueue_batch(SCHED, descs, YIELD_JOBS, NULL);
+	tina_scheduler_run(SCHED, 0, true, 0);
+	return (double)(GetNanos() - t0)/(YIELD_JOBS*YIELD_COUNT);
+}
+
+typedef struct {
+	tina_channel* in;
+	tina_channel* out;
+	bool serve;
+} ping_pong_ctx;
+
+static void PingPongJob(tina_job* job, void* user_data, unsigned* thread_id){
+	ping_pong_ctx* ctx = user_data;
+	for(unsigned i = 0; i < PING_PONGS; i++){
+		if(ctx->serve) tina_channel_send(job, ctx->out, ctx);
+		tina_channel_receive(job, ctx->in);
+		if(!ctx->serve) tina_channel_send(job, ctx->out, ctx);
+	}
+}
+
+static double BenchPingPong(void){
+	tina_channel* ping = tina_channel_new(SCHED, 1);
+	tina_channel* pong = tina_channel_new(SCHED, 1);
+	// The first job sends on 'ping' and receives on 'pong', the second echos it back.
+	ping_pong_ctx ctx[2] = {{.in = pong, .out = ping, .serve = true}, {.in = ping, .out = pong}};
+	tina_job_description descs[] = {
+		{.name = "PingJob", .func = PingPongJob, .user_data = &ctx[0], .no_fp = NO_FP},
+		{.name = "PongJob", .func = PingPongJob, .user_data = &ctx[1], .no_fp = NO_FP},
+	};
+	
+	uint64_t t0 = GetNanos();
+	tina_scheduler_enqueue_batch(SCHED, descs, 2, NULL);
+	tina_scheduler_run(SCHED, 0, true, 0);
+	uint64_t nanos = GetNanos() - t0;
+	
+	tina_channel_free(ping);
+	tina_channel_free(pong);
+	return (double)nanos/PING_PONGS;
+}
+
+int main(void){
+	printf("ABI: %s\n\n", ABI_NAME);
+	
+	printf("%-24s %12s\n", "ns per round trip", "");
+	printf("%-24s %12.1f\n", "tina_yield()", BenchTina(false));
+	printf("%-24s %12.1f\n", "tina_yield() no_fp", BenchTina(true));
+	printf("%-24s %12.1f\n", "swapcontext()", BenchUcontext());
+	printf("%-24s %12.1f\n", "thread handoff", BenchThreads());
+	printf("\n");
+	
+	SCHED = tina_scheduler_new(JOB_COUNT, 1, YIELD_JOBS + 2, STACK_SIZE);
+	
+	printf("%-24s %12s %12s %12s\n", "ns per", "scheduler", "handoff", "no_fp");
+	for(unsigned i = 0; i < 3; i++){
+		// Run through the scheduler loop, with handoff, and with handoff and no_fp jobs.
+		double results[3];
+		for(unsigned variant = 0; variant < 3; variant++){
+			tina_scheduler_handoff(SCHED, variant > 0);
+			NO_FP = (variant == 2);
+			switch(i){
+				case 0: results[variant] = BenchEmpty(); break;
+				case 1: results[variant] = BenchYield(); break;
+				case 2: results[variant] = BenchPingPong(); break;
+			}
+		}
+		
+		static const char* NAMES[] = {"empty job", "tina_job_yield()", "channel round trip"};
+		printf("%-24s %12.1f %12.1f %12.1f\n", NAMES[i], results[0], results[1], results[2]);
+	}
+	
+	tina_scheduler_free(SCHED);
+	return EXIT_SUCCESS;
+}
@@ -50,6 +50,10 @@ struct tina {
 	size_t size;
 	// Has the coroutine's body function exited? (readonly)
 	bool completed;
+	// Skip saving the callee saved FP/SIMD registers when switching. (optional)
+	// Only safe if the coroutine's code never touches them, ex: compiled with -mgeneral-regs-only.
+	// Both sides of a tina_swap() must agree on this, and it shouldn't be changed while the coroutine is suspended in the middle of it's body.
+	bool no_fp;
 	
 	// Private implementation details.
 	void* _sp;
@@ -68,6 +72,11 @@ tina* tina_init(void* buffer, size_t size, tina_func* body, void* user_data);
 // Treat them as non-reentrant or you'll get continuations and coroutines scrambled in a way that's probably more confusing than helpful.
 uintptr_t tina_yield(tina* coro, uintptr_t value);
 
+// Switch directly from the running coroutine 'from' into the suspended coroutine 'to' without returning to the caller first.
+// 'to' takes over the caller's continuation from 'from', so when 'to' yields to itself it returns to whoever last resumed 'from'.
+// 'from' is left suspended inside of tina_swap() and returns the value it's resumed with by the next tina_yield() or tina_swap() into it.
+uintptr_t tina_swap(tina* from, tina* to, uintptr_t value);
+
 #ifdef TINA_IMPLEMENTATION
 
 #ifndef _TINA_ASSERT
@@ -83,18 +92,32 @@ uintptr_t tina_yield(tina* coro, uintptr_t value);
 extern const uint64_t _tina_swap[];
 extern const uint64_t _tina_init_stack[];
 
+// The reduced state swap keeps the same stack layout, but skips the FP/SIMD registers.
+// Only the ARM ABIs have any to skip. x86_64 SysV has no callee saved vector registers, and the Win64 blobs aren't split.
+#if (__ARM_EABI__ || __aarch64__) && __GNUC__
+	extern const uint64_t _tina_swap_nofp[];
+	#define _TINA_SWAP_NOFP _tina_swap_nofp
+#else
+	#define _TINA_SWAP_NOFP _tina_swap
+#endif
+
+// Room for the coroutine header and the largest saved register frame (Win64, with its XMM registers).
+// What the body function needs on top of that is up to you, and stacks this small will only run trivial code.
+#define _TINA_MIN_STACK_SIZE 1024
+
 tina* tina_init(void* buffer, size_t size, tina_func* body, void* user_data){
-	_TINA_ASSERT(size >= 64*1024, "Tina Warning: Small stacks tend to not work on modern OSes. (Feel free to disable this if you have your reasons)");
+	_TINA_ASSERT(size >= _TINA_MIN_STACK_SIZE, "Tina Error: Stack is too small to hold the coroutine and its saved registers.");
 	if(buffer == NULL) buffer = malloc(size);
 	
 	// TODO check alignment?
 	tina* coro = (tina*)buffer;
 	coro->user_data = user_data;
 	coro->completed = false;
+	coro->no_fp = false;
 	coro->buffer = buffer;
 	coro->size = size;
 	coro->_magic = _TINA_MAGIC;
-
+	
 	typedef tina* init_func(tina* coro, tina_func* body, void** sp_loc, void* sp);
 	init_func* init = ((init_func*)(void*)_tina_init_stack);
 	return init(coro, body, &coro->_sp, (uint8_t*)buffer + size);
@@ -119,12 +142,28 @@ uintptr_t tina_yield(tina* coro, uintptr_t value){
 	_TINA_ASSERT(coro->_magic == _TINA_MAGIC, "Tina Error: Coroutine has likely had a stack overflow. Bad magic number detected.");
 	
 	typedef uintptr_t swap_func(tina* coro, uintptr_t value, void** sp);
-	swap_func* swap = ((swap_func*)(void*)_tina_swap);
+	swap_func* swap = ((swap_func*)(void*)(coro->no_fp ? _TINA_SWAP_NOFP : _tina_swap));
 	// TODO swap no longer needs the coro pointer.
 	// Could save a couple instructions? Meh. Too much testing effort.
 	return swap(NULL, value, &coro->_sp);
 }
 
+uintptr_t tina_swap(tina* from, tina* to, uintptr_t value){
+	_TINA_ASSERT(from->_magic == _TINA_MAGIC, "Tina Error: Coroutine has likely had a stack overflow. Bad magic number detected.");
+	_TINA_ASSERT(to->_magic == _TINA_MAGIC, "Tina Error: Coroutine has likely had a stack overflow. Bad magic number detected.");
+	_TINA_ASSERT(from != to, "Tina Error: Cannot swap a coroutine with itself.");
+	_TINA_ASSERT(from->no_fp == to->no_fp, "Tina Error: Cannot swap between coroutines with different 'no_fp' settings.");
+	
+	// Hand the caller's continuation over to 'to', then swap into 'to' while saving the current state in 'from'.
+	void* caller = from->_sp;
+	from->_sp = to->_sp;
+	to->_sp = caller;
+	
+	typedef uintptr_t swap_func(tina* coro, uintptr_t value, void** sp);
+	swap_func* swap = ((swap_func*)(void*)(from->no_fp ? _TINA_SWAP_NOFP : _tina_swap));
+	return swap(NULL, value, &from->_sp);
+}
+
 #if __APPLE__
 	#define TINA_SYMBOL(sym) "_"#sym
 #else
@@ -173,6 +212,18 @@ uintptr_t tina_yield(tina* coro, uintptr_t value){
 	// And perform a normal return instruction.
 	// This will return from tina_yield() in the new coroutine.
 	asm("  bx lr");
+	
+	// Same as _tina_swap(), but reserves the space for q4-q7 instead of saving them so the stack layouts match.
+	asm("_tina_swap_nofp:");
+	asm("  push {r4-r11, lr}");
+	asm("  sub sp, sp, #64");
+	asm("  mov r3, sp");
+	asm("  ldr sp, [r2]");
+	asm("  str r3, [r2]");
+	asm("  add sp, sp, #64");
+	asm("  pop {r4-r11, lr}");
+	asm("  mov r0, r1");
+	asm("  bx lr");
 #elif __amd64__ && (__unix__ || __APPLE__)
 	#define ARG0 "rdi"
 	#define ARG1 "rsi"
@@ -243,7 +294,7 @@ uintptr_t tina_yield(tina* coro, uintptr_t value){
 		0xb8489020ec834800, (uint64_t)_tina_context,
 		0x909090909090e0ff, 0x9090909090909090,
 	};
-
+	
 	// Assembled and dumped from win64-swap.S
 	TINA_SECTION_ATTRIBUTE
 	const uint64_t _tina_swap[] = {
@@ -282,7 +333,7 @@ uintptr_t tina_yield(tina* coro, uintptr_t value){
 	asm("  mov sp, x3");
 	asm("  mov lr, #0");
 	asm("  b _tina_context");
-
+	
 	asm(TINA_SYMBOL(_tina_swap:));
 	asm("  sub sp, sp, 0xA0");
 	asm("  stp x19, x20, [sp, 0x00]");
@@ -312,6 +363,28 @@ uintptr_t tina_yield(tina* coro, uintptr_t value){
 	asm("  add sp, sp, 0xA0");
 	asm("  mov x0, x1");
 	asm("  ret");
+	
+	asm(TINA_SYMBOL(_tina_swap_nofp:));
+	asm("  sub sp, sp, 0xA0");
+	asm("  stp x19, x20, [sp, 0x00]");
+	asm("  stp x21, x22, [sp, 0x10]");
+	asm("  stp x23, x24, [sp, 0x20]");
+	asm("  stp x25, x26, [sp, 0x30]");
+	asm("  stp x27, x28, [sp, 0x40]");
+	asm("  stp x29, x30, [sp, 0x50]");
+	asm("  mov x3, sp");
+	asm("  ldr x4, [x2]");
+	asm("  mov sp, x4");
+	asm("  str x3, [x2]");
+	asm("  ldp x19, x20, [sp, 0x00]");
+	asm("  ldp x21, x22, [sp, 0x10]");
+	asm("  ldp x23, x24, [sp, 0x20]");
+	asm("  ldp x25, x26, [sp, 0x30]");
+	asm("  ldp x27, x28, [sp, 0x40]");
+	asm("  ldp x29, x30, [sp, 0x50]");
+	asm("  add sp, sp, 0xA0");
+	asm("  mov x0, x1");
+	asm("  ret");
 #endif
 
 #endif // TINA_IMPLEMENTATION
@@ -24,6 +24,7 @@ SOFTWARE.
 #include <stdint.h>
 #include <stddef.h>
 #include <stdalign.h>
+#include <stdio.h>
 
 #ifndef TINA_JOBS_H
 #define TINA_JOBS_H
@@ -38,6 +39,10 @@ typedef struct tina_scheduler tina_scheduler;
 typedef struct tina_job tina_job;
 // Opaque type for a job group.
 typedef struct tina_group tina_group;
+// Opaque type for a trace recorder.
+typedef struct tina_trace tina_trace;
+// Opaque type for a channel.
+typedef struct tina_channel tina_channel;
 
 // Job function prototype.
 // 'job' is a reference to the job to use with the yield/switch/abort functions.
@@ -54,25 +59,50 @@ typedef struct {
 	void* user_data;
 	// Index of the queue to run the job on.
 	uint8_t queue_idx;
+	// Minimum stack size the job needs. It runs on a fiber from the smallest pool that fits. (optional)
+	size_t stack_size;
+	// The job never touches FP/SIMD registers (ex: compiled with -mgeneral-regs-only), so switching can skip them. (optional)
+	// Only makes a difference on ARM. Jobs only hand off directly to other jobs with the same setting.
+	bool no_fp;
 } tina_job_description;
 
 // Counter used to signal when a group of jobs is done.
 // Can be allocated anywhere (stack, in an object, etc), and does not need to be freed.
 struct tina_group {
+	// Number of jobs in the group that have finished running. (readonly)
+	uint32_t completed;
+	// Number of jobs in the group that were cancelled before they started. (readonly)
+	uint32_t cancelled;
+	
 	tina_job* _job;
 	uint32_t _count;
 	uint32_t _magic;
 };
 
+// A pool of fibers that share a stack size.
+// Use several pools to run many jobs with small stacks alongside a few that need large ones.
+typedef struct {
+	unsigned fiber_count;
+	// Must be a power of two.
+	size_t stack_size;
+} tina_fiber_pool;
+
 // Get the allocation size for a jobs instance.
 size_t tina_scheduler_size(unsigned job_count, unsigned queue_count, unsigned fiber_count, size_t stack_size);
 // Initialize memory for a scheduler. Use tina_scheduler_size() to figure out how much you need.
 tina_scheduler* tina_scheduler_init(void* buffer, unsigned job_count, unsigned queue_count, unsigned fiber_count, size_t stack_size);
+// Like tina_scheduler_size(), but with multiple fiber pools.
+size_t tina_scheduler_size_pools(unsigned job_count, unsigned queue_count, const tina_fiber_pool* pools, unsigned pool_count);
+// Like tina_scheduler_init(), but with multiple fiber pools.
+// Jobs get a fiber from the smallest pool that fits their 'stack_size', or a larger one if that pool is empty.
+tina_scheduler* tina_scheduler_init_pools(void* buffer, unsigned job_count, unsigned queue_count, const tina_fiber_pool* pools, unsigned pool_count);
 // Destroy a scheduler. Any unfinished jobs will be lost. Flush your queues if you need them to finish gracefully.
 void tina_scheduler_destroy(tina_scheduler* sched);
 
 // Convenience constructor. Allocate and initialize a scheduler.
 tina_scheduler* tina_scheduler_new(unsigned job_count, unsigned queue_count, unsigned fiber_count, size_t stack_size);
+// Convenience constructor. Allocate and initialize a scheduler with multiple fiber pools.
+tina_scheduler* tina_scheduler_new_pools(unsigned job_count, unsigned queue_count, const tina_fiber_pool* pools, unsigned pool_count);
 // Convenience destructor. Destroy and free a scheduler.
 void tina_scheduler_free(tina_scheduler* sched);
 
@@ -86,9 +116,17 @@ void tina_scheduler_queue_priority(tina_scheduler* sched, unsigned queue_idx, un
 void tina_scheduler_run(tina_scheduler* sched, unsigned queue_idx, bool flush, unsigned thread_id);
 // Pause execution of jobs on all threads as soon as their current jobs finish.
 void tina_scheduler_pause(tina_scheduler* sched);
+// Enable or disable direct handoff. (enabled by default)
+// When a job finishes or suspends, the next job from the runner's queue is switched to directly from the job's fiber
+// instead of returning to the tina_scheduler_run() loop first. A finished job's fiber runs the next job if it hasn't started yet.
+void tina_scheduler_handoff(tina_scheduler* sched, bool enabled);
 
 // Groups must be initialized before use.
 void tina_group_init(tina_group* group);
+// Remove all of the group's jobs that haven't started yet from the queues without running them.
+// Jobs that are already running, yielding or waiting are not affected. Returns the number of jobs cancelled.
+// If a job is waiting on the group, it's woken up as if the cancelled jobs had completed.
+size_t tina_group_cancel(tina_scheduler* sched, tina_group* group);
 
 // Add jobs to the scheduler, optionally pass the address of a tina_group to track when the jobs have completed.
 void tina_scheduler_enqueue_batch(tina_scheduler* sched, const tina_job_description* list, size_t count, tina_group* group);
@@ -103,6 +141,9 @@ void tina_job_yield(tina_job* job);
 void tina_job_switch_queue(tina_job* job, unsigned queue_idx);
 // Immediately abort the execution of a job and mark it as completed.
 void tina_job_abort(tina_job* job);
+// Suspend the current job for at least 'nanos' nanoseconds without blocking the thread it was running on.
+// Call it in a loop to run periodic work.
+void tina_job_sleep(tina_job* job, uint64_t nanos);
 
 // NOTE: tina_job_yield() and tina_job_abort() must be called from within the actual job.
 // Very bad, stack corrupting things will happen if you call it from the outside.
@@ -112,6 +153,9 @@ static inline void tina_scheduler_enqueue(tina_scheduler* sched, const char* nam
 	tina_job_description desc = {.name = name, .func = func, .user_data = user_data, .queue_idx = (uint8_t)queue_idx};
 	tina_scheduler_enqueue_batch(sched, &desc, 1, group);
 }
+// Add a job to the scheduler after a delay of at least 'delay_nanos' nanoseconds.
+// The job is added to 'group' immediately, so waiting on the group includes delayed jobs.
+void tina_scheduler_enqueue_delayed(tina_scheduler* sched, const tina_job_description* desc, tina_group* group, uint64_t delay_nanos);
 // Convenience method. Enqueue some jobs and wait for them all to finish.
 void tina_scheduler_join(tina_scheduler* sched, const tina_job_description* list, size_t count, tina_job* job);
 
@@ -119,6 +163,42 @@ void tina_scheduler_join(tina_scheduler* sched, const tina_job_description* list
 // Don't run this from a job! It will block the runner thread and probably cause a deadlock.
 void tina_scheduler_wait_blocking(tina_scheduler* sched, tina_group* group, unsigned threshold);
 
+// Get the allocation size for a channel that can hold 'capacity' items.
+size_t tina_channel_size(unsigned capacity);
+// Initialize memory for a channel. Use tina_channel_size() to figure out how much you need.
+// 'capacity' must be a power of two. Channels use the scheduler's lock, so they can only be used with jobs from 'sched'.
+tina_channel* tina_channel_init(void* buffer, tina_scheduler* sched, unsigned capacity);
+// Convenience constructor. Allocate and initialize a channel.
+tina_channel* tina_channel_new(tina_scheduler* sched, unsigned capacity);
+// Convenience destructor. Free a channel. Make sure no jobs are still waiting on it.
+void tina_channel_free(tina_channel* chan);
+
+// Send a non-NULL item to a channel. Suspends the job while the channel is full.
+void tina_channel_send(tina_job* job, tina_channel* chan, void* item);
+// Receive an item from a channel in FIFO order. Suspends the job while the channel is empty.
+// Returns NULL once the channel has been closed and all of it's items have been received.
+void* tina_channel_receive(tina_job* job, tina_channel* chan);
+// Close a channel and wake up any jobs waiting to receive from it. Don't send to a channel after closing it.
+void tina_channel_close(tina_channel* chan);
+
+// Get the allocation size for a trace recorder with a ring buffer of 'event_count' events for each of 'thread_count' threads.
+size_t tina_trace_size(unsigned thread_count, unsigned event_count);
+// Initialize memory for a trace recorder. Use tina_trace_size() to figure out how much you need.
+// When a thread's ring buffer fills up, its oldest events are overwritten.
+tina_trace* tina_trace_init(void* buffer, unsigned thread_count, unsigned event_count);
+// Convenience constructor. Allocate and initialize a trace recorder.
+tina_trace* tina_trace_new(unsigned thread_count, unsigned event_count);
+// Convenience destructor. Free a trace recorder.
+void tina_trace_free(tina_trace* trace);
+
+// Attach a trace recorder to the scheduler, or pass NULL to detach it.
+// Job start/end, yield/wait and wake events are recorded for each thread running jobs.
+// The 'thread_id' values passed to tina_scheduler_run() must be less than the trace's thread count.
+void tina_scheduler_trace(tina_scheduler* sched, tina_trace* trace);
+// Write the recorded events as Chrome trace JSON. (Load it in chrome://tracing or ui.perfetto.dev)
+// Don't call this while the scheduler is still running jobs.
+void tina_trace_write_json(tina_trace* trace, FILE* file);
+
 
 #ifdef TINA_JOBS_IMPLEMENTATION
 
@@ -139,14 +219,36 @@ void tina_scheduler_wait_blocking(tina_scheduler* sched, tina_group* group, unsi
 #define _TINA_COND_WAIT(_SIG_, _LOCK_) cnd_wait(&_SIG_, &_LOCK_);
 #define _TINA_COND_SIGNAL(_SIG_) cnd_signal(&_SIG_)
 #define _TINA_COND_BROADCAST(_SIG_) cnd_broadcast(&_SIG_)
+// Wait until an absolute time from _TINA_JOBS_NANOS(). Must evaluate to true if it timed out.
+#define _TINA_COND_TIMEDWAIT(_SIG_, _LOCK_, _NANOS_) (cnd_timedwait(&_SIG_, &_LOCK_, &(struct timespec){ \
+	.tv_sec = (time_t)((_NANOS_)/1000000000), .tv_nsec = (long)((_NANOS_)%1000000000)}) == thrd_timedout)
 #endif
 
+// Override this to use your own clock for tracing and timers. Must return nanoseconds.
+#ifndef _TINA_JOBS_NANOS
+#include <time.h>
+static inline uint64_t _tina_jobs_nanos(void){
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return 1000000000*(uint64_t)ts.tv_sec + (uint64_t)ts.tv_nsec;
+}
+#define _TINA_JOBS_NANOS() _tina_jobs_nanos()
+#endif
+
+#include <stdatomic.h>
+
 struct tina_job {
 	tina_job_description desc;
 	tina_scheduler* scheduler;
 	tina* fiber;
 	unsigned thread_id;
 	tina_group* group;
+	
+	// Queue of the runner thread the job is running on, used to find jobs to hand off to.
+	struct _tina_queue* _run_queue;
+	// Link for the timer wheel or a channel's wait list, and timer deadline in ticks.
+	tina_job* _next;
+	uint64_t _deadline;
 };
 
 typedef struct {
@@ -154,6 +256,11 @@ typedef struct {
 	size_t count;
 } _tina_stack;
 
+typedef struct {
+	_tina_stack fibers;
+	size_t stack_size;
+} _tina_fiber_pool;
+
 // Simple power of two circular queues.
 typedef struct _tina_queue _tina_queue;
 struct _tina_queue{
@@ -169,16 +276,40 @@ struct _tina_queue{
 	unsigned semaphore_count;
 };
 
+// Timer ticks are 2^20 ns, or about 1 ms.
+#define _TINA_TIMER_TICK_SHIFT 20
+// Hierarchical timer wheel with 4 levels of 64 slots. Covers about 4.5 hours before timers are clamped.
+#define _TINA_TIMER_SLOT_BITS 6
+#define _TINA_TIMER_SLOTS (1 << _TINA_TIMER_SLOT_BITS)
+#define _TINA_TIMER_LEVELS 4
+
+typedef struct {
+	// Each slot is a linked list of jobs.
+	tina_job* slots[_TINA_TIMER_LEVELS][_TINA_TIMER_SLOTS];
+	// The next tick to be processed.
+	uint64_t tick;
+	size_t count;
+} _tina_timer_wheel;
+
 struct tina_scheduler {
 	// Thread control variables.
-	bool _pause;
+	bool _pause, _handoff;
 	_TINA_MUTEX_T _lock;
 	
 	_tina_queue* _queues;
 	size_t _queue_count;
 	
 	// Keep the jobs and fiber pools in a stack so recently used items are fresh in the cache.
-	_tina_stack _fibers, _job_pool;
+	_tina_stack _job_pool;
+	// Fiber pools sorted by stack size.
+	_tina_fiber_pool* _fiber_pools;
+	unsigned _fiber_pool_count;
+	
+	// Optional trace recorder.
+	tina_trace* _trace;
+	
+	// Delayed and sleeping jobs.
+	_tina_timer_wheel _timers;
 };
 
 enum _TINA_STATUS {
@@ -186,19 +317,49 @@ enum _TINA_STATUS {
 	_TINA_STATUS_WAITING,
 	_TINA_STATUS_YIELDING,
 	_TINA_STATUS_ABORTED,
+	_TINA_STATUS_SLEEPING,
+};
+
+enum _TINA_TRACE_TYPE {
+	_TINA_TRACE_BEGIN,
+	_TINA_TRACE_END,
+	_TINA_TRACE_WAKE,
+};
+
+typedef struct {
+	uint64_t nanos;
+	const char* name;
+	uint8_t type;
+	// Job status for end events, or true for begin events if the job is resuming.
+	uint8_t status;
+} _tina_trace_event;
+
+// Ring buffers are only written by their own thread, so they don't need a lock.
+typedef struct {
+	_tina_trace_event* events;
+	atomic_size_t head;
+} _tina_trace_ring;
+
+struct tina_trace {
+	_tina_trace_ring* _rings;
+	unsigned _thread_count;
+	size_t _mask;
+	uint64_t _epoch;
 };
 
+static tina_job* _tina_job_suspend(tina_job* job, unsigned status);
+
 static uintptr_t _tina_jobs_fiber(tina* fiber, uintptr_t value){
 	tina_scheduler* sched = (tina_scheduler*)fiber->user_data;
+	tina_job* job = (tina_job*)value;
 	while(true){
 		// Unlock the mutex while executing a job.
 		_TINA_MUTEX_UNLOCK(sched->_lock); {
-			tina_job* job = (tina_job*)value;
 			job->desc.func(job, job->desc.user_data, &job->thread_id);
 		} _TINA_MUTEX_LOCK(sched->_lock);
 		
-		// Yield the completed status back to the scheduler, and recieve the next job.
-		value = tina_yield(fiber, _TINA_STATUS_COMPLETE);
+		// Finish the job, and recieve the next job to run on this fiber.
+		job = _tina_job_suspend(job, _TINA_STATUS_COMPLETE);
 	}
 	
 	// Unreachable.
@@ -207,14 +368,15 @@ static uintptr_t _tina_jobs_fiber(tina* fiber, uintptr_t value){
 
 static inline size_t _tina_jobs_align(size_t n){return -(-n & ~_TINA_JOBS_MIN_ALIGN);}
 
-size_t tina_scheduler_size(unsigned job_count, unsigned queue_count, unsigned fiber_count, size_t stack_size){
+size_t tina_scheduler_size_pools(unsigned job_count, unsigned queue_count, const tina_fiber_pool* pools, unsigned pool_count){
 	size_t size = 0;
 	// Size of scheduler.
 	size += _tina_jobs_align(sizeof(tina_scheduler));
 	// Size of queues.
 	size += _tina_jobs_align(queue_count*sizeof(_tina_queue));
-	// Size of fiber pool array.
-	size += _tina_jobs_align(fiber_count*sizeof(void*));
+	// Size of fiber pools and their arrays.
+	size += _tina_jobs_align(pool_count*sizeof(_tina_fiber_pool));
+	for(unsigned i = 0; i < pool_count; i++) size += _tina_jobs_align(pools[i].fiber_count*sizeof(void*));
 	// Size of job pool array.
 	size += _tina_jobs_align(job_count*sizeof(void*));
 	// Size of queue arrays.
@@ -222,13 +384,18 @@ size_t tina_scheduler_size(unsigned job_count, unsigned queue_count, unsigned fi
 	// Size of jobs.
 	size += job_count*_tina_jobs_align(sizeof(tina_job));
 	// Size of fibers.
-	size += fiber_count*stack_size;
+	for(unsigned i = 0; i < pool_count; i++) size += pools[i].fiber_count*pools[i].stack_size;
 	return size;
 }
 
-tina_scheduler* tina_scheduler_init(void* _buffer, unsigned job_count, unsigned queue_count, unsigned fiber_count, size_t stack_size){
+size_t tina_scheduler_size(unsigned job_count, unsigned queue_count, unsigned fiber_count, size_t stack_size){
+	tina_fiber_pool pool = {.fiber_count = fiber_count, .stack_size = stack_size};
+	return tina_scheduler_size_pools(job_count, queue_count, &pool, 1);
+}
+
+tina_scheduler* tina_scheduler_init_pools(void* _buffer, unsigned job_count, unsigned queue_count, const tina_fiber_pool* pools, unsigned pool_count){
 	_TINA_ASSERT((job_count & (job_count - 1)) == 0, "Tina Jobs Error: Job count must be a power of two.");
-	_TINA_ASSERT((stack_size & (stack_size - 1)) == 0, "Tina Jobs Error: Stack size must be a power of two.");
+	_TINA_ASSERT(pool_count > 0, "Tina Jobs Error: Scheduler needs at least one fiber pool.");
 	uint8_t* cursor = (uint8_t*)_buffer;
 	
 	// Sub allocate all of the memory for the various arrays.
@@ -236,8 +403,23 @@ tina_scheduler* tina_scheduler_init(void* _buffer, unsigned job_count, unsigned
 	cursor += _tina_jobs_align(sizeof(tina_scheduler));
 	sched->_queues = (_tina_queue*)cursor;
 	cursor += _tina_jobs_align(queue_count*sizeof(_tina_queue));
-	sched->_fibers = (_tina_stack){.arr = (void**)cursor, .count = 0};
-	cursor += _tina_jobs_align(fiber_count*sizeof(void*));
+	sched->_fiber_pools = (_tina_fiber_pool*)cursor;
+	sched->_fiber_pool_count = pool_count;
+	cursor += _tina_jobs_align(pool_count*sizeof(_tina_fiber_pool));
+	for(unsigned i = 0; i < pool_count; i++){
+		_TINA_ASSERT((pools[i].stack_size & (pools[i].stack_size - 1)) == 0, "Tina Jobs Error: Stack size must be a power of two.");
+		
+		// Insertion sort the pools by stack size.
+		unsigned j = i;
+		for(unsigned k = 0; k < i; k++){
+			_TINA_ASSERT(pools[k].stack_size != pools[i].stack_size, "Tina Jobs Error: Fiber pools must have different stack sizes.");
+		}
+		for(; j > 0 && sched->_fiber_pools[j - 1].stack_size > pools[i].stack_size; j--){
+			sched->_fiber_pools[j] = sched->_fiber_pools[j - 1];
+		}
+		sched->_fiber_pools[j] = (_tina_fiber_pool){.fibers = {.arr = (void**)cursor, .count = 0}, .stack_size = pools[i].stack_size};
+		cursor += _tina_jobs_align(pools[i].fiber_count*sizeof(void*));
+	}
 	sched->_job_pool = (_tina_stack){.arr = (void**)cursor, .count = 0};
 	cursor += _tina_jobs_align(job_count*sizeof(void*));
 	
@@ -258,22 +440,37 @@ tina_scheduler* tina_scheduler_init(void* _buffer, unsigned job_count, unsigned
 		cursor += _tina_jobs_align(sizeof(tina_job));
 	}
 	
-	// Initialize the fibers and fill the pool.
-	sched->_fibers.count = fiber_count;
-	for(unsigned i = 0; i < fiber_count; i++){
-		tina* fiber = tina_init(cursor, stack_size, _tina_jobs_fiber, &sched);
-		fiber->name = "TINA JOB FIBER";
-		fiber->user_data = sched;
-		sched->_fibers.arr[i] = fiber;
-		cursor += stack_size;
+	// Initialize the fibers and fill the pools.
+	for(unsigned i = 0; i < pool_count; i++){
+		_tina_fiber_pool* pool = &sched->_fiber_pools[i];
+		unsigned fiber_count = 0;
+		for(unsigned j = 0; j < pool_count; j++){
+			if(pools[j].stack_size == pool->stack_size) fiber_count = pools[j].fiber_count;
+		}
+		
+		for(unsigned j = 0; j < fiber_count; j++){
+			tina* fiber = tina_init(cursor, pool->stack_size, _tina_jobs_fiber, sched);
+			fiber->name = "TINA JOB FIBER";
+			fiber->user_data = sched;
+			pool->fibers.arr[pool->fibers.count++] = fiber;
+			cursor += pool->stack_size;
+		}
 	}
 	
 	// Initialize the control variables.
 	_TINA_MUTEX_INIT(sched->_lock);
+	sched->_handoff = true;
+	sched->_trace = NULL;
+	sched->_timers = (_tina_timer_wheel){.tick = _TINA_JOBS_NANOS() >> _TINA_TIMER_TICK_SHIFT};
 	
 	return sched;
 }
 
+tina_scheduler* tina_scheduler_init(void* buffer, unsigned job_count, unsigned queue_count, unsigned fiber_count, size_t stack_size){
+	tina_fiber_pool pool = {.fiber_count = fiber_count, .stack_size = stack_size};
+	return tina_scheduler_init_pools(buffer, job_count, queue_count, &pool, 1);
+}
+
 void tina_scheduler_destroy(tina_scheduler* sched){
 	_TINA_MUTEX_DESTROY(sched->_lock);
 	for(unsigned i = 0; i < sched->_queue_count; i++) _TINA_COND_DESTROY(sched->_queues[i].semaphore_signal);
@@ -284,6 +481,11 @@ tina_scheduler* tina_scheduler_new(unsigned job_count, unsigned queue_count, uns
 	return tina_scheduler_init(buffer, job_count, queue_count, fiber_count, stack_size);
 }
 
+tina_scheduler* tina_scheduler_new_pools(unsigned job_count, unsigned queue_count, const tina_fiber_pool* pools, unsigned pool_count){
+	void* buffer = malloc(tina_scheduler_size_pools(job_count, queue_count, pools, pool_count));
+	return tina_scheduler_init_pools(buffer, job_count, queue_count, pools, pool_count);
+}
+
 void tina_scheduler_free(tina_scheduler* sched){
 	tina_scheduler_destroy(sched);
 	free(sched);
@@ -297,7 +499,7 @@ void tina_scheduler_queue_priority(tina_scheduler* sched, unsigned queue_idx, un
 	_tina_queue* next = &sched->_queues[fallback_idx];
 	_TINA_ASSERT(prev->next == NULL, "Tina Jobs Error: Queue already has a fallback assigned.");
 	_TINA_ASSERT(next->prev == NULL, "Tina Jobs Error: Queue already has a fallback assigned.");
-
+	
 	prev->next = next;
 	next->prev = prev;
 }
@@ -312,6 +514,58 @@ static inline tina_job* _tina_queue_next_job(_tina_queue* queue){
 	return NULL;
 }
 
+// Index of the smallest fiber pool that fits the stack size.
+static inline unsigned _tina_fiber_pool_index(tina_scheduler* sched, size_t stack_size){
+	unsigned idx = 0;
+	while(idx < sched->_fiber_pool_count - 1 && sched->_fiber_pools[idx].stack_size < stack_size) idx++;
+	_TINA_ASSERT(sched->_fiber_pools[idx].stack_size >= stack_size, "Tina Jobs Error: No fiber pool has a large enough stack.");
+	return idx;
+}
+
+// Take a fiber for the job from the smallest pool that fits, or a larger one if it's empty.
+static inline tina* _tina_fiber_pop(tina_scheduler* sched, const tina_job* job){
+	for(unsigned i = _tina_fiber_pool_index(sched, job->desc.stack_size); i < sched->_fiber_pool_count; i++){
+		_tina_stack* fibers = &sched->_fiber_pools[i].fibers;
+		if(fibers->count > 0){
+			tina* fiber = (tina*)fibers->arr[--fibers->count];
+			fiber->no_fp = job->desc.no_fp;
+			return fiber;
+		}
+	}
+	
+	_TINA_ASSERT(false, "Tina Jobs Error: Ran out of fibers.");
+	return NULL;
+}
+
+static inline void _tina_fiber_push(tina_scheduler* sched, tina* fiber){
+	_tina_stack* fibers = &sched->_fiber_pools[_tina_fiber_pool_index(sched, fiber->size)].fibers;
+	fibers->arr[fibers->count++] = fiber;
+}
+
+// Like _tina_queue_next_job(), but leaves the job in the queue. 'queue' is set to the queue the job was found in.
+static inline tina_job* _tina_queue_peek_job(_tina_queue** queue){
+	_tina_queue* cursor = *queue;
+	do {
+		if(cursor->count > 0){
+			*queue = cursor;
+			return (tina_job*)cursor->arr[cursor->tail & cursor->mask];
+		}
+	} while((cursor = cursor->next));
+	return NULL;
+}
+
+static inline void _tina_trace_record(tina_trace* trace, unsigned thread_id, uint8_t type, const tina_job* job, uint8_t status){
+	if(trace == NULL) return;
+	_TINA_ASSERT(thread_id < trace->_thread_count, "Tina Jobs Error: Thread id is out of range for the trace recorder.");
+	
+	_tina_trace_ring* ring = &trace->_rings[thread_id];
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	ring->events[head & trace->_mask] = (_tina_trace_event){
+		.nanos = _TINA_JOBS_NANOS(), .name = job->desc.name, .type = type, .status = status,
+	};
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
 static inline void _tina_queue_signal(_tina_queue* queue){
 	do {
 		if(queue->semaphore_count){
@@ -321,6 +575,104 @@ static inline void _tina_queue_signal(_tina_queue* queue){
 	} while((queue = queue->prev));
 }
 
+// Remove 'count' jobs from a group. Returns the job that was waiting on it if it needs to be woken up.
+static inline tina_job* _tina_group_release(tina_scheduler* sched, tina_group* group, uint32_t count){
+	// While a job waits, the count is the number of pending jobs minus its threshold. That goes below zero if more
+	// jobs are cancelled at once than the threshold leaves, or if jobs finish after the waiter is woken but before it resumes.
+	// tina_job_wait() adds the threshold back either way, so treat the count as signed and only wake on the first crossing.
+	int32_t prev = (int32_t)group->_count;
+	group->_count -= count;
+	if(prev <= 0 || (int32_t)group->_count > 0) return NULL;
+	
+	// Push the waiting job to the front of it's queue.
+	tina_job* job = group->_job;
+	_tina_queue* queue = &sched->_queues[job->desc.queue_idx];
+	queue->arr[--queue->tail & queue->mask] = job;
+	queue->count++;
+	_tina_queue_signal(queue);
+	// TODO is pushing it to the front the best thing to do?
+	return job;
+}
+
+static inline void _tina_queue_push(tina_scheduler* sched, tina_job* job){
+	// Push the job to the back of it's queue.
+	_tina_queue* queue = &sched->_queues[job->desc.queue_idx];
+	queue->arr[queue->head++ & queue->mask] = job;
+	queue->count++;
+	_tina_queue_signal(queue);
+}
+
+static void _tina_timers_insert(_tina_timer_wheel* wheel, tina_job* job){
+	if(job->_deadline < wheel->tick){
+		// Already expired.
+		_tina_queue_push(job->scheduler, job);
+		wheel->count--;
+		return;
+	}
+	
+	// Find the lowest level with a range that covers the deadline, and clamp it to the highest level otherwise.
+	uint64_t delta = job->_deadline - wheel->tick;
+	uint64_t tick = job->_deadline;
+	unsigned level = 0;
+	while(level < _TINA_TIMER_LEVELS - 1 && delta >= (1ull << (_TINA_TIMER_SLOT_BITS*(level + 1)))) level++;
+	uint64_t range = 1ull << (_TINA_TIMER_SLOT_BITS*_TINA_TIMER_LEVELS);
+	if(delta >= range) tick = wheel->tick + range - 1;
+	
+	tina_job** slot = &wheel->slots[level][(tick >> (_TINA_TIMER_SLOT_BITS*level)) & (_TINA_TIMER_SLOTS - 1)];
+	job->_next = *slot;
+	*slot = job;
+}
+
+// Move timers that have expired by 'now' onto their queues.
+static void _tina_timers_advance(_tina_timer_wheel* wheel, uint64_t now){
+	uint64_t now_tick = now >> _TINA_TIMER_TICK_SHIFT;
+	while(wheel->count && wheel->tick <= now_tick){
+		uint64_t tick = wheel->tick;
+		
+		// Cascade timers down from higher levels when the lower levels wrap around.
+		for(unsigned level = _TINA_TIMER_LEVELS - 1; level > 0; level--){
+			unsigned shift = _TINA_TIMER_SLOT_BITS*level;
+			if(tick & ((1ull << shift) - 1)) continue;
+			
+			tina_job** slot = &wheel->slots[level][(tick >> shift) & (_TINA_TIMER_SLOTS - 1)];
+			tina_job* job = *slot;
+			*slot = NULL;
+			while(job){
+				tina_job* next = job->_next;
+				_tina_timers_insert(wheel, job);
+				job = next;
+			}
+		}
+		
+		// Everything left in the current slot has expired.
+		tina_job** slot = &wheel->slots[0][tick & (_TINA_TIMER_SLOTS - 1)];
+		tina_job* job = *slot;
+		*slot = NULL;
+		while(job){
+			tina_job* next = job->_next;
+			_tina_queue_push(job->scheduler, job);
+			wheel->count--;
+			job = next;
+		}
+		
+		wheel->tick++;
+	}
+	
+	// Nothing to process, skip ahead.
+	if(wheel->count == 0 && wheel->tick <= now_tick) wheel->tick = now_tick + 1;
+}
+
+// Time in nanoseconds when the timer wheel next needs to be advanced.
+static uint64_t _tina_timers_next_wakeup(_tina_timer_wheel* wheel){
+	// Check for a deadline in the lowest level first, otherwise wake up for the next cascade.
+	uint64_t tick = wheel->tick;
+	for(unsigned i = 0; i < _TINA_TIMER_SLOTS; i++, tick++){
+		if(wheel->slots[0][tick & (_TINA_TIMER_SLOTS - 1)]) break;
+		if(i > 0 && (tick & (_TINA_TIMER_SLOTS - 1)) == 0) break;
+	}
+	return tick << _TINA_TIMER_TICK_SHIFT;
+}
+
 void tina_scheduler_run(tina_scheduler* sched, unsigned queue_idx, bool flush, unsigned thread_id){
 	// Job loop is only unlocked while running a job or waiting for a wakeup.
 	_TINA_MUTEX_LOCK(sched->_lock); {
@@ -331,49 +683,36 @@ void tina_scheduler_run(tina_scheduler* sched, unsigned queue_idx, bool flush, u
 		
 		// If not in flush mode, keep looping until the scheduler is paused.
 		while(flush || !sched->_pause){
+			if(sched->_timers.count) _tina_timers_advance(&sched->_timers, _TINA_JOBS_NANOS());
+			
 			tina_job* job = _tina_queue_next_job(queue);
 			if(job){
-				_TINA_ASSERT(sched->_fibers.count > 0, "Tina Jobs Error: Ran out of fibers.");
 				// Assign a fiber and the thread data. (Jobs that are resuming already have a fiber)
-				if(job->fiber == NULL) job->fiber = (tina*)sched->_fibers.arr[--sched->_fibers.count];
+				bool resuming = (job->fiber != NULL);
+				if(!resuming) job->fiber = _tina_fiber_pop(sched, job);
 				job->thread_id = thread_id;
+				job->_run_queue = queue;
 				
 				// Yield to the job's fiber to run it.
-				switch(tina_yield(job->fiber, (uintptr_t)job)){
-					case _TINA_STATUS_ABORTED: {
-						// Worker fiber state not reset with a clean exit. Need to do it explicitly.
-						tina_init(job->fiber, job->fiber->size, _tina_jobs_fiber, sched);
-					}; // FALLTHROUGH
-					case _TINA_STATUS_COMPLETE: {
-						// Return the components to the pools.
-						sched->_job_pool.arr[sched->_job_pool.count++] = job;
-						sched->_fibers.arr[sched->_fibers.count++] = job->fiber;
-						
-						// Did it have a group, and was it the last job being waited for?
-						tina_group* group = job->group;
-						if(group && --group->_count == 0){
-							// Push the waiting job to the front of it's queue.
-							_tina_queue* queue = &sched->_queues[group->_job->desc.queue_idx];
-							queue->arr[--queue->tail & queue->mask] = group->_job;
-							queue->count++;
-							_tina_queue_signal(queue);
-							// TODO is pushing it to the front the best thing to do?
-						}
-					} break;
-					case _TINA_STATUS_YIELDING:{
-						// Push the job to the back of the queue.
-						_tina_queue* queue = &sched->_queues[job->desc.queue_idx];
-						queue->arr[queue->head++ & queue->mask] = job;
-						queue->count++;
-						_tina_queue_signal(queue);
-					} break;
-					case _TINA_STATUS_WAITING: {
-						// Do nothing. The job will be re-enqueued when it's done waiting.
-					} break;
+				// The jobs do their own bookkeeping in _tina_job_suspend() and may hand off to other jobs before returning here.
+				_tina_trace_record(sched->_trace, thread_id, _TINA_TRACE_BEGIN, job, resuming);
+				tina* aborted = (tina*)tina_yield(job->fiber, (uintptr_t)job);
+				
+				if(aborted){
+					// Worker fiber state not reset with a clean exit. Need to do it explicitly.
+					tina_init(aborted, aborted->size, _tina_jobs_fiber, sched);
+					_tina_fiber_push(sched, aborted);
 				}
-			} else if(flush){
-				// No more tasks so we are done if run in flush mode.
+			} else if(flush && sched->_timers.count == 0){
+				// No more tasks or pending timers so we are done if run in flush mode.
 				break;
+			} else if(sched->_timers.count){
+				// Sleep until more work is added to the queue, or the next timer might expire.
+				queue->semaphore_count++;
+				uint64_t wakeup = _tina_timers_next_wakeup(&sched->_timers);
+				if(_TINA_COND_TIMEDWAIT(queue->semaphore_signal, sched->_lock, wakeup)){
+					if(queue->semaphore_count) queue->semaphore_count--;
+				}
 			} else {
 				// Sleep until more work is added to the queue.
 				queue->semaphore_count++;
@@ -383,6 +722,91 @@ void tina_scheduler_run(tina_scheduler* sched, unsigned queue_idx, bool flush, u
 	} _TINA_MUTEX_UNLOCK(sched->_lock);
 }
 
+// Finish or suspend the running job, then switch to the next job or back to the scheduler loop.
+// Must be called from the job's fiber with the lock held. Returns the job to run when the fiber is resumed.
+static tina_job* _tina_job_suspend(tina_job* job, unsigned status){
+	tina_scheduler* sched = job->scheduler;
+	tina* fiber = job->fiber;
+	unsigned thread_id = job->thread_id;
+	_tina_queue* run_queue = job->_run_queue;
+	_tina_trace_record(sched->_trace, thread_id, _TINA_TRACE_END, job, (uint8_t)status);
+	
+	switch(status){
+		case _TINA_STATUS_COMPLETE:
+		case _TINA_STATUS_ABORTED: {
+			// Return the job to the pool.
+			sched->_job_pool.arr[sched->_job_pool.count++] = job;
+			
+			// Did it have a group, and was it the last job being waited for?
+			tina_group* group = job->group;
+			if(group){
+				group->completed++;
+				tina_job* waiting = _tina_group_release(sched, group, 1);
+				if(waiting) _tina_trace_record(sched->_trace, thread_id, _TINA_TRACE_WAKE, waiting, 0);
+			}
+		} break;
+		case _TINA_STATUS_YIELDING: {
+			_tina_queue_push(sched, job);
+		} break;
+		default: {
+			// Do nothing. The job will be re-enqueued when it's done waiting.
+		} break;
+	}
+	
+	if(status == _TINA_STATUS_ABORTED){
+		// The fiber can't be reused until the scheduler loop resets it. Unreachable after the yield.
+		tina_yield(fiber, (uintptr_t)fiber);
+		return NULL;
+	}
+	
+	tina_job* next = NULL;
+	if(sched->_handoff && !sched->_pause){
+		if(sched->_timers.count) _tina_timers_advance(&sched->_timers, _TINA_JOBS_NANOS());
+		
+		// Only hand off to jobs that switch the same registers, otherwise the scheduler loop's state could be lost.
+		_tina_queue* queue = run_queue;
+		next = _tina_queue_peek_job(&queue);
+		if(next && (next->fiber ? next->fiber->no_fp : next->desc.no_fp) == fiber->no_fp){
+			queue->count--;
+			queue->tail++;
+		} else {
+			next = NULL;
+		}
+	}
+	
+	// Completed jobs give their fiber back unless the next job would get a fiber from the same pool.
+	bool reuse_fiber = (status == _TINA_STATUS_COMPLETE && next && next->fiber == NULL);
+	if(reuse_fiber) reuse_fiber = (sched->_fiber_pools[_tina_fiber_pool_index(sched, next->desc.stack_size)].stack_size == fiber->size);
+	if(status == _TINA_STATUS_COMPLETE && !reuse_fiber) _tina_fiber_push(sched, fiber);
+	
+	if(next == NULL){
+		// Nothing to hand off to. Return to the scheduler loop.
+		return (tina_job*)tina_yield(fiber, 0);
+	}
+	
+	bool resuming = (next->fiber != NULL);
+	next->thread_id = thread_id;
+	next->_run_queue = run_queue;
+	_tina_trace_record(sched->_trace, thread_id, _TINA_TRACE_BEGIN, next, resuming);
+	
+	if(next == job){
+		// The job was re-enqueued and is next in line anyway. Keep running it.
+		return job;
+	} else if(reuse_fiber){
+		next->fiber = fiber;
+		return next;
+	} else {
+		if(!resuming) next->fiber = _tina_fiber_pop(sched, next);
+		return (tina_job*)tina_swap(fiber, next->fiber, (uintptr_t)next);
+	}
+}
+
+void tina_scheduler_handoff(tina_scheduler* sched, bool enabled){
+	_TINA_MUTEX_LOCK(sched->_lock); {
+		sched->_handoff = enabled;
+	} _TINA_MUTEX_UNLOCK(sched->_lock);
+}
+
 void tina_scheduler_pause(tina_scheduler* sched){
 	_TINA_MUTEX_LOCK(sched->_lock); {
 		sched->_pause = true;
@@ -395,7 +819,59 @@ void tina_scheduler_pause(tina_scheduler* sched){
 
 void tina_group_init(tina_group* group){
 	// Count is initailized to 1 because tina_job_wait() also decrements the count for symmetry reasons.
-	(*group) = (tina_group){._job = NULL, ._count = 1, ._magic = _TINA_MAGIC};
+	(*group) = (tina_group){.completed = 0, .cancelled = 0, ._job = NULL, ._count = 1, ._magic = _TINA_MAGIC};
+}
+
+size_t tina_group_cancel(tina_scheduler* sched, tina_group* group){
+	size_t cancelled = 0;
+	_TINA_MUTEX_LOCK(sched->_lock); {
+		_TINA_ASSERT(group->_magic == _TINA_MAGIC, "Tina Jobs Error: Group is corrupt or uninitialized");
+		
+		for(unsigned i = 0; i < sched->_queue_count; i++){
+			_tina_queue* queue = &sched->_queues[i];
+			
+			// Compact the queue in place, dropping the group's jobs that don't have a fiber yet.
+			size_t cursor = queue->tail;
+			for(size_t j = queue->tail; j != queue->head; j++){
+				tina_job* job = (tina_job*)queue->arr[j & queue->mask];
+				if(job->group == group && job->fiber == NULL){
+					// Return the job to the pool.
+					sched->_job_pool.arr[sched->_job_pool.count++] = job;
+					cancelled++;
+				} else {
+					queue->arr[cursor++ & queue->mask] = job;
+				}
+			}
+			queue->head = cursor;
+			queue->count = cursor - queue->tail;
+		}
+		
+		// Drop delayed jobs that haven't started yet too.
+		_tina_timer_wheel* wheel = &sched->_timers;
+		for(unsigned level = 0; level < _TINA_TIMER_LEVELS; level++){
+			for(unsigned i = 0; i < _TINA_TIMER_SLOTS; i++){
+				tina_job** link = &wheel->slots[level][i];
+				while(*link){
+					tina_job* job = *link;
+					if(job->group == group && job->fiber == NULL){
+						*link = job->_next;
+						sched->_job_pool.arr[sched->_job_pool.count++] = job;
+						wheel->count--;
+						cancelled++;
+					} else {
+						link = &job->_next;
+					}
+				}
+			}
+		}
+		
+		if(cancelled){
+			group->cancelled += cancelled;
+			_tina_group_release(sched, group, cancelled);
+		}
+	} _TINA_MUTEX_UNLOCK(sched->_lock);
+	
+	return cancelled;
 }
 
 static void _tina_scheduler_enqueue_batch_nolock(tina_scheduler* sched, const tina_job_description* list, size_t count, tina_group* group){
@@ -414,10 +890,7 @@ static void _tina_scheduler_enqueue_batch_nolock(tina_scheduler* sched, const ti
 		(*job) = (tina_job){.desc = list[i], .scheduler = sched, .fiber = NULL, .thread_id = 0, .group = group};
 		
 		// Push it to the proper queue.
-		_tina_queue* queue = &sched->_queues[list[i].queue_idx];
-		queue->arr[queue->head++ & queue->mask] = job;
-		queue->count++;
-		_tina_queue_signal(queue);
+		_tina_queue_push(sched, job);
 	}
 }
 
@@ -443,6 +916,38 @@ size_t tina_scheduler_enqueue_throttled(tina_scheduler* sched, const tina_job_de
 	return count;
 }
 
+static void _tina_timers_add(_tina_timer_wheel* wheel, tina_job* job, uint64_t delay_nanos){
+	uint64_t now = _TINA_JOBS_NANOS();
+	// The wheel isn't advanced while it's empty. Catch it up first.
+	if(wheel->count == 0) wheel->tick = now >> _TINA_TIMER_TICK_SHIFT;
+	
+	// Round up so timers never expire early.
+	uint64_t tick_nanos = 1ull << _TINA_TIMER_TICK_SHIFT;
+	job->_deadline = (now + delay_nanos + tick_nanos - 1) >> _TINA_TIMER_TICK_SHIFT;
+	wheel->count++;
+	_tina_timers_insert(wheel, job);
+	
+	// A worker idling on the job's queue may be in an untimed wait. Wake it so it waits on the new deadline instead.
+	_tina_queue_signal(&job->scheduler->_queues[job->desc.queue_idx]);
+}
+
+void tina_scheduler_enqueue_delayed(tina_scheduler* sched, const tina_job_description* desc, tina_group* group, uint64_t delay_nanos){
+	_TINA_MUTEX_LOCK(sched->_lock); {
+		if(group){
+			_TINA_ASSERT(group->_magic == _TINA_MAGIC, "Tina Jobs Error: Group is corrupt or uninitialized");
+			group->_count++;
+		}
+		
+		_TINA_ASSERT(sched->_job_pool.count > 0, "Tina Jobs Error: Ran out of jobs.");
+		_TINA_ASSERT(desc->func, "Tina Jobs Error: Job must have a body function.");
+		_TINA_ASSERT(desc->queue_idx < sched->_queue_count, "Tina Jobs Error: Invalid queue index.");
+		
+		tina_job* job = (tina_job*)sched->_job_pool.arr[--sched->_job_pool.count];
+		(*job) = (tina_job){.desc = *desc, .scheduler = sched, .fiber = NULL, .thread_id = 0, .group = group};
+		_tina_timers_add(&sched->_timers, job, delay_nanos);
+	} _TINA_MUTEX_UNLOCK(sched->_lock);
+}
+
 void tina_job_wait(tina_job* job, tina_group* group, unsigned threshold){
 	tina_scheduler* sched = job->scheduler;
 	_TINA_MUTEX_LOCK(sched->_lock); {
@@ -453,8 +958,8 @@ void tina_job_wait(tina_job* job, tina_group* group, unsigned threshold){
 		if(--group->_count > threshold){
 			group->_count -= threshold;
 			// Yield until the counter hits zero.
-			tina_yield(group->_job->fiber, _TINA_STATUS_WAITING);
-			// Restore the counter for the remaining jobs.
+			_tina_job_suspend(job, _TINA_STATUS_WAITING);
+			// Restore the counter for the remaining jobs. Wraps back around if cancelling took it below zero.
 			group->_count += threshold;
 		}
 		
@@ -467,7 +972,7 @@ void tina_job_wait(tina_job* job, tina_group* group, unsigned threshold){
 void tina_job_yield(tina_job* job){
 	tina_scheduler* sched = job->scheduler;
 	_TINA_MUTEX_LOCK(sched->_lock); {
-		tina_yield(job->fiber, _TINA_STATUS_YIELDING);
+		_tina_job_suspend(job, _TINA_STATUS_YIELDING);
 	} _TINA_MUTEX_UNLOCK(sched->_lock);
 }
 
@@ -475,14 +980,22 @@ void tina_job_switch_queue(tina_job* job, unsigned queue_idx){
 	tina_scheduler* sched = job->scheduler;
 	_TINA_MUTEX_LOCK(sched->_lock); {
 		job->desc.queue_idx = queue_idx;
-		tina_yield(job->fiber, _TINA_STATUS_YIELDING);
+		_tina_job_suspend(job, _TINA_STATUS_YIELDING);
+	} _TINA_MUTEX_UNLOCK(sched->_lock);
+}
+
+void tina_job_sleep(tina_job* job, uint64_t nanos){
+	tina_scheduler* sched = job->scheduler;
+	_TINA_MUTEX_LOCK(sched->_lock); {
+		_tina_timers_add(&sched->_timers, job, nanos);
+		_tina_job_suspend(job, _TINA_STATUS_SLEEPING);
 	} _TINA_MUTEX_UNLOCK(sched->_lock);
 }
 
 void tina_job_abort(tina_job* job){
 	tina_scheduler* sched = job->scheduler;
 	_TINA_MUTEX_LOCK(sched->_lock); {
-		tina_yield(job->fiber, _TINA_STATUS_ABORTED);
+		_tina_job_suspend(job, _TINA_STATUS_ABORTED);
 	} _TINA_MUTEX_UNLOCK(sched->_lock);
 }
 
@@ -522,6 +1035,209 @@ void tina_scheduler_wait_blocking(tina_scheduler* sched, tina_group* group, unsi
 	_TINA_COND_DESTROY(ctx.wakeup);
 }
 
+typedef struct {
+	tina_job* head;
+	tina_job* tail;
+} _tina_job_list;
+
+struct tina_channel {
+	tina_scheduler* _sched;
+	void** _arr;
+	size_t _head, _tail, _count, _mask;
+	bool _closed;
+	// Jobs waiting for space or items.
+	_tina_job_list _senders, _receivers;
+};
+
+static inline void _tina_job_list_push(_tina_job_list* list, tina_job* job){
+	job->_next = NULL;
+	if(list->tail) list->tail->_next = job; else list->head = job;
+	list->tail = job;
+}
+
+static inline tina_job* _tina_job_list_pop(_tina_job_list* list){
+	tina_job* job = list->head;
+	if(job){
+		list->head = job->_next;
+		if(list->head == NULL) list->tail = NULL;
+	}
+	return job;
+}
+
+// Re-enqueue the first job waiting in 'list'. 'job' is the running job doing the waking.
+static inline void _tina_channel_wake(tina_scheduler* sched, _tina_job_list* list, tina_job* job){
+	tina_job* waiting = _tina_job_list_pop(list);
+	if(waiting){
+		_tina_queue_push(sched, waiting);
+		if(job) _tina_trace_record(sched->_trace, job->thread_id, _TINA_TRACE_WAKE, waiting, 0);
+	}
+}
+
+size_t tina_channel_size(unsigned capacity){
+	return _tina_jobs_align(sizeof(tina_channel)) + capacity*sizeof(void*);
+}
+
+tina_channel* tina_channel_init(void* _buffer, tina_scheduler* sched, unsigned capacity){
+	_TINA_ASSERT(capacity > 0 && (capacity & (capacity - 1)) == 0, "Tina Jobs Error: Channel capacity must be a power of two.");
+	uint8_t* cursor = (uint8_t*)_buffer;
+	
+	tina_channel* chan = (tina_channel*)cursor;
+	cursor += _tina_jobs_align(sizeof(tina_channel));
+	(*chan) = (tina_channel){._sched = sched, ._arr = (void**)cursor, ._mask = capacity - 1};
+	return chan;
+}
+
+tina_channel* tina_channel_new(tina_scheduler* sched, unsigned capacity){
+	void* buffer = malloc(tina_channel_size(capacity));
+	return tina_channel_init(buffer, sched, capacity);
+}
+
+void tina_channel_free(tina_channel* chan){
+	free(chan);
+}
+
+void tina_channel_send(tina_job* job, tina_channel* chan, void* item){
+	tina_scheduler* sched = chan->_sched;
+	_TINA_ASSERT(item, "Tina Jobs Error: Channel items must not be NULL.");
+	_TINA_ASSERT(job->scheduler == sched, "Tina Jobs Error: Channel belongs to a different scheduler.");
+	
+	_TINA_MUTEX_LOCK(sched->_lock); {
+		// Another sender may have taken the free slot before this job resumes, so check again after waking.
+		while(chan->_count > chan->_mask){
+			_tina_job_list_push(&chan->_senders, job);
+			_tina_job_suspend(job, _TINA_STATUS_WAITING);
+		}
+		_TINA_ASSERT(!chan->_closed, "Tina Jobs Error: Sent to a closed channel.");
+		
+		chan->_arr[chan->_head++ & chan->_mask] = item;
+		chan->_count++;
+		_tina_channel_wake(sched, &chan->_receivers, job);
+	} _TINA_MUTEX_UNLOCK(sched->_lock);
+}
+
+void* tina_channel_receive(tina_job* job, tina_channel* chan){
+	tina_scheduler* sched = chan->_sched;
+	_TINA_ASSERT(job->scheduler == sched, "Tina Jobs Error: Channel belongs to a different scheduler.");
+	
+	void* item = NULL;
+	_TINA_MUTEX_LOCK(sched->_lock); {
+		while(chan->_count == 0 && !chan->_closed){
+			_tina_job_list_push(&chan->_receivers, job);
+			_tina_job_suspend(job, _TINA_STATUS_WAITING);
+		}
+		
+		if(chan->_count > 0){
+			item = chan->_arr[chan->_tail++ & chan->_mask];
+			chan->_count--;
+			_tina_channel_wake(sched, &chan->_senders, job);
+		}
+	} _TINA_MUTEX_UNLOCK(sched->_lock);
+	
+	return item;
+}
+
+void tina_channel_close(tina_channel* chan){
+	tina_scheduler* sched = chan->_sched;
+	_TINA_MUTEX_LOCK(sched->_lock); {
+		chan->_closed = true;
+		while(chan->_receivers.head) _tina_channel_wake(sched, &chan->_receivers, NULL);
+	} _TINA_MUTEX_UNLOCK(sched->_lock);
+}
+
+size_t tina_trace_size(unsigned thread_count, unsigned event_count){
+	size_t size = 0;
+	size += _tina_jobs_align(sizeof(tina_trace));
+	size += _tina_jobs_align(thread_count*sizeof(_tina_trace_ring));
+	size += thread_count*_tina_jobs_align(event_count*sizeof(_tina_trace_event));
+	return size;
+}
+
+tina_trace* tina_trace_init(void* _buffer, unsigned thread_count, unsigned event_count){
+	_TINA_ASSERT((event_count & (event_count - 1)) == 0, "Tina Jobs Error: Trace event count must be a power of two.");
+	uint8_t* cursor = (uint8_t*)_buffer;
+	
+	tina_trace* trace = (tina_trace*)cursor;
+	cursor += _tina_jobs_align(sizeof(tina_trace));
+	trace->_rings = (_tina_trace_ring*)cursor;
+	cursor += _tina_jobs_align(thread_count*sizeof(_tina_trace_ring));
+	
+	for(unsigned i = 0; i < thread_count; i++){
+		trace->_rings[i].events = (_tina_trace_event*)cursor;
+		atomic_init(&trace->_rings[i].head, 0);
+		cursor += _tina_jobs_align(event_count*sizeof(_tina_trace_event));
+	}
+	
+	trace->_thread_count = thread_count;
+	trace->_mask = event_count - 1;
+	trace->_epoch = _TINA_JOBS_NANOS();
+	return trace;
+}
+
+tina_trace* tina_trace_new(unsigned thread_count, unsigned event_count){
+	void* buffer = malloc(tina_trace_size(thread_count, event_count));
+	return tina_trace_init(buffer, thread_count, event_count);
+}
+
+void tina_trace_free(tina_trace* trace){
+	free(trace);
+}
+
+void tina_scheduler_trace(tina_scheduler* sched, tina_trace* trace){
+	_TINA_MUTEX_LOCK(sched->_lock); {
+		sched->_trace = trace;
+	} _TINA_MUTEX_UNLOCK(sched->_lock);
+}
+
+static void _tina_trace_write_name(FILE* file, const char* name){
+	if(name == NULL) name = "(unnamed job)";
+	for(fputc('"', file); *name; name++){
+		if(*name == '"' || *name == '\\') fputc('\\', file);
+		if((unsigned char)*name >= 0x20) fputc(*name, file);
+	}
+	fputc('"', file);
+}
+
+void tina_trace_write_json(tina_trace* trace, FILE* file){
+	static const char* STATUS_NAMES[] = {
+		[_TINA_STATUS_COMPLETE] = "complete",
+		[_TINA_STATUS_WAITING] = "wait",
+		[_TINA_STATUS_YIELDING] = "yield",
+		[_TINA_STATUS_ABORTED] = "abort",
+		[_TINA_STATUS_SLEEPING] = "sleep",
+	};
+	
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	const char* separator = "";
+	for(unsigned tid = 0; tid < trace->_thread_count; tid++){
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}", separator, tid, tid);
+		separator = ",\n";
+		
+		_tina_trace_ring* ring = &trace->_rings[tid];
+		size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		size_t capacity = trace->_mask + 1;
+		for(size_t i = (head > capacity ? head - capacity : 0); i < head; i++){
+			_tina_trace_event* event = &ring->events[i & trace->_mask];
+			double micros = (double)(int64_t)(event->nanos - trace->_epoch)/1e3;
+			
+			fprintf(file, "%s{\"name\":", separator);
+			_tina_trace_write_name(file, event->name);
+			switch(event->type){
+				case _TINA_TRACE_BEGIN: {
+					fprintf(file, ",\"ph\":\"B\",\"args\":{\"resume\":%s}", event->status ? "true" : "false");
+				} break;
+				case _TINA_TRACE_END: {
+					fprintf(file, ",\"ph\":\"E\",\"args\":{\"status\":\"%s\"}", STATUS_NAMES[event->status]);
+				} break;
+				case _TINA_TRACE_WAKE: {
+					fprintf(file, ",\"ph\":\"i\",\"s\":\"t\",\"cat\":\"wake\"");
+				} break;
+			}
+			fprintf(file, ",\"ts\":%.3f,\"pid\":0,\"tid\":%u}", micros, tid);
+		}
+	}
+	fprintf(file, "\n]}\n");
+}
+
 #endif // TINA_JOB_IMPLEMENTATION
 
 #ifdef __cplusplus
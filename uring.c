@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "tinycthread.h"
+#include "uring.h"
+
+struct uring {
+	int fd;
+	// Serializes submissions.
+	mtx_t lock;
+	
+	void* sq_map;
+	size_t sq_map_size;
+	_Atomic unsigned* sq_head;
+	_Atomic unsigned* sq_tail;
+	unsigned* sq_array;
+	unsigned sq_mask, sq_entries;
+	struct io_uring_sqe* sqes;
+	
+	void* cq_map;
+	size_t cq_map_size;
+	_Atomic unsigned* cq_head;
+	_Atomic unsigned* cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe* cqes;
+};
+
+static void* MapRing(int fd, size_t size, off_t offset){
+	void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+	return map == MAP_FAILED ? NULL : map;
+}
+
+uring* UringNew(unsigned entries){
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int fd = syscall(SYS_io_uring_setup, entries, &params);
+	if(fd < 0) return NULL;
+	
+	uring* ring = calloc(1, sizeof(uring));
+	ring->fd = fd;
+	mtx_init(&ring->lock, mtx_plain);
+	
+	ring->sq_map_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+	ring->cq_map_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP){
+		// Both rings share one mapping.
+		if(ring->cq_map_size > ring->sq_map_size) ring->sq_map_size = ring->cq_map_size;
+		ring->sq_map = MapRing(fd, ring->sq_map_size, IORING_OFF_SQ_RING);
+		ring->cq_map = ring->sq_map;
+	} else {
+		ring->sq_map = MapRing(fd, ring->sq_map_size, IORING_OFF_SQ_RING);
+		ring->cq_map = MapRing(fd, ring->cq_map_size, IORING_OFF_CQ_RING);
+	}
+	ring->sqes = MapRing(fd, params.sq_entries*sizeof(struct io_uring_sqe), IORING_OFF_SQES);
+	ring->sq_entries = params.sq_entries;
+	
+	if(!ring->sq_map || !ring->cq_map || !ring->sqes){
+		UringFree(ring);
+		return NULL;
+	}
+	
+	uint8_t* sq = ring->sq_map;
+	ring->sq_head = (_Atomic unsigned*)(sq + params.sq_off.head);
+	ring->sq_tail = (_Atomic unsigned*)(sq + params.sq_off.tail);
+	ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+	
+	uint8_t* cq = ring->cq_map;
+	ring->cq_head = (_Atomic unsigned*)(cq + params.cq_off.head);
+	ring->cq_tail = (_Atomic unsigned*)(cq + params.cq_off.tail);
+	ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	
+	return ring;
+}
+
+void UringFree(uring* ring){
+	if(ring->sqes) munmap(ring->sqes, ring->sq_entries*sizeof(struct io_uring_sqe));
+	if(ring->cq_map && ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_size);
+	if(ring->sq_map) munmap(ring->sq_map, ring->sq_map_size);
+	close(ring->fd);
+	mtx_destroy(&ring->lock);
+	free(ring);
+}
+
+void UringRead(uring* ring, int fd, void* dst, size_t size, uint64_t offset, void* user_data){
+	mtx_lock(&ring->lock);
+	// Only this side writes the tail, the kernel advances the head as it consumes entries.
+	unsigned tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(ring->sq_head, memory_order_acquire);
+	if(tail - head == ring->sq_entries){
+		fprintf(stderr, "io_uring submission queue overflow.\n");
+		abort();
+	}
+	
+	unsigned idx = tail & ring->sq_mask;
+	struct io_uring_sqe* sqe = ring->sqes + idx;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)dst;
+	sqe->len = size;
+	sqe->off = offset;
+	sqe->user_data = (uintptr_t)user_data;
+	ring->sq_array[idx] = idx;
+	atomic_store_explicit(ring->sq_tail, tail + 1, memory_order_release);
+	
+	if(syscall(SYS_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) != 1){
+		fprintf(stderr, "io_uring submission failed.\n");
+		abort();
+	}
+	mtx_unlock(&ring->lock);
+}
+
+void UringWait(uring* ring, void (*func)(void* user_data, int result)){
+	unsigned head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+	while(head == tail){
+		syscall(SYS_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		tail = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+	}
+	
+	for(; head != tail; head++){
+		const struct io_uring_cqe* cqe = ring->cqes + (head & ring->cq_mask);
+		func((void*)(uintptr_t)cqe->user_data, cqe->res);
+	}
+	atomic_store_explicit(ring->cq_head, head, memory_order_release);
+}
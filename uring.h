@@ -0,0 +1,22 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A minimal io_uring for file reads, using the raw system calls so there's no dependency on liburing.
+// Any thread may submit reads, but only one thread at a time may wait for them.
+typedef struct uring uring;
+
+// Returns NULL if io_uring isn't available, such as on old kernels or where seccomp blocks it.
+uring* UringNew(unsigned entries);
+void UringFree(uring* ring);
+
+// Submit a read of 'size' bytes at 'offset'. 'user_data' is passed back when it completes.
+// The caller must not have more than 'entries' reads in flight.
+void UringRead(uring* ring, int fd, void* dst, size_t size, uint64_t offset, void* user_data);
+// Block until at least one read completes, then call 'func' with each completed read's result (bytes read or -errno).
+void UringWait(uring* ring, void (*func)(void* user_data, int result));
+
+#endif // URING_H